@@ -35,6 +35,13 @@ if %ERRORLEVEL% neq 0 ( exit /b %ERRORLEVEL% )
 ) > out\bluenoise_hlsl.h
 if %ERRORLEVEL% neq 0 ( exit /b %ERRORLEVEL% )
 
+@REM denoiser.hlsl kernels
+@REM atrous_filter
+dxc %dxc_args% -T cs_6_5 ^
+    -Fh out\denoiser_hlsl.h /Vn g_atrous_filter_bytecode -E atrous_filter ^
+    src/denoiser.hlsl
+if %ERRORLEVEL% neq 0 ( exit /b %ERRORLEVEL% )
+
 @REM raytracing.hlsl DXIL library
 dxc %dxc_args% -T lib_6_5 ^
     -Fh out\raytracing_hlsl.h /Vn g_raytracing_hlsl_bytecode ^
@@ -50,7 +57,7 @@ cl ^
     ^
     -Ilib -Ilib\imgui -I. ^
     -DCPP -DUNICODE -DDEBUG ^
-    src\geometry.cpp src\parse_obj.cpp src\bluenoise.cpp src\device.cpp src\raytracing.cpp src\main.cpp ^
+    src\geometry.cpp src\parse_obj.cpp src\bluenoise.cpp src\guiding.cpp src\translucent.cpp src\denoiser.cpp src\device.cpp src\raytracing.cpp src\main.cpp ^
     ^
     out\lib.lib ^
     user32.lib ^
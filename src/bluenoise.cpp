@@ -101,7 +101,9 @@ UINT generate_sample_points(
     ID3D12Resource* ib, UINT ib_offset,
     ID3D12Resource* vb,
     XMFLOAT4X4* transform,
-    float rejection_radius
+    float rejection_radius,
+    Array<SamplePoint>* points_readback,
+    Array<XMFLOAT3>*    normals_readback
 ) {
     // resource management
     Array<ID3D12Resource*> resources = {};      // GPU resources used by kernels
@@ -351,10 +353,127 @@ UINT generate_sample_points(
     }
     Fence::wait(g_cmd_queue, &fence);
 
+    if (points_readback || normals_readback) { // read back the sample points for host-side acceleration structures
+        ID3D12Resource* points_readback_buffer  = create_buffer((*sample_points_buffer)->GetDesc().Width, D3D12_RESOURCE_STATE_COPY_DEST, D3D12_HEAP_TYPE_READBACK);
+        ID3D12Resource* normals_readback_buffer = create_buffer((*point_normals_buffer)->GetDesc().Width, D3D12_RESOURCE_STATE_COPY_DEST, D3D12_HEAP_TYPE_READBACK);
+        array_push(&resources, points_readback_buffer);
+        array_push(&resources, normals_readback_buffer);
+
+        CHECK_RESULT(cmd_list->Reset(g_cmd_allocator, NULL));
+        if (points_readback)  read_from_buffer(cmd_list, *sample_points_buffer, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, &points_readback_buffer);
+        if (normals_readback) read_from_buffer(cmd_list, *point_normals_buffer, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, &normals_readback_buffer);
+        CHECK_RESULT(cmd_list->Close());
+        g_cmd_queue->ExecuteCommandLists(1, (ID3D12CommandList**) &cmd_list);
+        Fence::increment_and_signal_and_wait(g_cmd_queue, &fence);
+
+        if (points_readback) {
+            points_readback->len = 0;
+            copy_from_readback_buffer(array_push_uninitialized(points_readback, out.sample_points_count), points_readback_buffer);
+        }
+        if (normals_readback) {
+            normals_readback->len = 0;
+            copy_from_readback_buffer(array_push_uninitialized(normals_readback, out.sample_points_count), normals_readback_buffer);
+        }
+    }
+
     Device::release_temp_resources(&resources);
     array_free(&resources);
 
     return out.sample_points_count;
 }
 
+// Ulichney 1993, "The void-and-cluster method for dither array generation"
+Array<float> generate_mask(UINT size) {
+    const UINT  pixels_count = size*size;
+    const float sigma        = 1.5;
+
+    // gaussian energy filter with toroidal wrapping
+    Array<float> filter = array_init<float>(pixels_count);
+    for (UINT y = 0; y < size; y++) {
+        for (UINT x = 0; x < size; x++) {
+            float dx = min(x, size - x);
+            float dy = min(y, size - y);
+            array_push(&filter, expf(-(dx*dx + dy*dy) / (2*sigma*sigma)));
+        }
+    }
+
+    Array<bool>  pattern = array_init<bool> (pixels_count);
+    Array<float> energy  = array_init<float>(pixels_count);
+    Array<UINT>  ranks   = array_init<UINT> (pixels_count);
+    for (UINT i = 0; i < pixels_count; i++) {
+        array_push(&pattern, false);
+        array_push(&energy,  0.0f);
+        array_push(&ranks,   0u);
+    }
+
+    auto toggle = [&](UINT pixel) {
+        pattern[pixel] = !pattern[pixel];
+        float sign = pattern[pixel] ? 1 : -1;
+
+        UINT px = pixel % size, py = pixel / size;
+        for (UINT y = 0; y < size; y++) {
+            for (UINT x = 0; x < size; x++) {
+                UINT offset = ((y + size - py) % size)*size + (x + size - px) % size;
+                energy[y*size + x] += sign * filter[offset];
+            }
+        }
+    };
+    auto tightest_cluster = [&]() {
+        UINT best = 0; float best_energy = -INFINITY;
+        for (UINT i = 0; i < pixels_count; i++) {
+            if (pattern[i] && energy[i] > best_energy) { best = i; best_energy = energy[i]; }
+        }
+        return best;
+    };
+    auto largest_void = [&]() {
+        UINT best = 0; float best_energy = INFINITY;
+        for (UINT i = 0; i < pixels_count; i++) {
+            if (!pattern[i] && energy[i] < best_energy) { best = i; best_energy = energy[i]; }
+        }
+        return best;
+    };
+
+    // random initial pattern
+    UINT initial_count = pixels_count / 10;
+    for (UINT i = 0; i < initial_count;) {
+        UINT pixel = rand() % pixels_count;
+        if (pattern[pixel]) continue;
+        toggle(pixel);
+        i += 1;
+    }
+
+    // relax: move the tightest cluster into the largest void until they coincide
+    for (UINT i = 0; i < pixels_count; i++) {
+        UINT cluster = tightest_cluster(); toggle(cluster);
+        UINT vacancy = largest_void();     toggle(vacancy);
+        if (cluster == vacancy) break;
+    }
+
+    Array<UINT> initial = array_init<UINT>(initial_count);
+    for (UINT i = 0; i < pixels_count; i++) if (pattern[i]) array_push(&initial, i);
+
+    // phase 1: rank the initial pattern by removing its tightest clusters
+    for (UINT rank = initial_count; rank > 0; rank--) {
+        UINT cluster = tightest_cluster(); toggle(cluster);
+        ranks[cluster] = rank - 1;
+    }
+    for (auto pixel : initial) toggle(pixel);
+
+    // phase 2: rank the remaining pixels by filling the largest voids
+    for (UINT rank = initial_count; rank < pixels_count; rank++) {
+        UINT vacancy = largest_void(); toggle(vacancy);
+        ranks[vacancy] = rank;
+    }
+
+    Array<float> mask = array_init<float>(pixels_count);
+    for (auto rank : ranks) array_push(&mask, (rank + 0.5f) / pixels_count);
+
+    array_free(&filter);
+    array_free(&pattern);
+    array_free(&energy);
+    array_free(&ranks);
+    array_free(&initial);
+    return mask;
+}
+
 } // namespace Bluenoise
@@ -84,8 +84,14 @@ UINT generate_sample_points(
     ID3D12Resource* ib, UINT ib_offset,
     ID3D12Resource* vb,
     XMFLOAT4X4* transform,
-    float rejection_radius
+    float rejection_radius,
+    Array<SamplePoint>* points_readback  = NULL, // also copy the sample points to the host if given
+    Array<XMFLOAT3>*    normals_readback = NULL
 );
 
+// host-generated size*size blue-noise dither mask using the void-and-cluster method
+// values are pixel ranks normalized to [0, 1)
+Array<float> generate_mask(UINT size);
+
 } // namespace Bluenoise
 #endif // CPP
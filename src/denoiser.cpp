@@ -0,0 +1,129 @@
+#include "denoiser.h"
+
+#include "device.h"
+using Device::g_device;
+
+namespace Denoiser {
+
+#include "out/denoiser_hlsl.h"
+
+bool              g_enable           = false;
+bool              g_denoise_captures = true;
+DenoiserConstants g_constants        = {};
+
+ID3D12RootSignature* g_root_signature = NULL;
+ID3D12PipelineState* g_atrous_filter_pso = NULL;
+
+// allocated only while enabled
+ID3D12Resource* g_filtered[2] = {};
+ID3D12Resource* g_output      = NULL;
+
+D3D12_GPU_DESCRIPTOR_HANDLE g_descriptor_table = {};
+
+void init() {
+    g_constants.iterations_count = 5;
+    g_constants.color_sigma      = 0.5;
+    g_constants.normal_power     = 64;
+    g_constants.depth_sigma      = 0.01;
+    g_constants.albedo_sigma     = 0.1;
+
+    { // shaders
+        // g_root_signature
+        CHECK_RESULT(g_device->CreateRootSignature(0, g_atrous_filter_bytecode, _countof(g_atrous_filter_bytecode), IID_PPV_ARGS(&g_root_signature)));
+
+        D3D12_COMPUTE_PIPELINE_STATE_DESC desc = {};
+        desc.pRootSignature = g_root_signature;
+
+        // g_atrous_filter_pso
+        desc.CS = CD3DX12_SHADER_BYTECODE((void*) g_atrous_filter_bytecode, _countof(g_atrous_filter_bytecode));
+        CHECK_RESULT(g_device->CreateComputePipelineState(&desc, IID_PPV_ARGS(&g_atrous_filter_pso)));
+    }
+}
+
+void update_resolution(UINT width, UINT height) {
+    Pair<ID3D12Resource**, DXGI_FORMAT> textures[] = {
+        { &g_filtered[0], DXGI_FORMAT_R16G16B16A16_FLOAT },
+        { &g_filtered[1], DXGI_FORMAT_R16G16B16A16_FLOAT },
+        { &g_output,      PIXEL_FORMAT                   },
+    };
+    for (auto& texture : textures) {
+        if (*texture._0) (*texture._0)->Release();
+        *texture._0 = NULL;
+
+        if (g_enable) {
+            D3D12_RESOURCE_DESC resource_desc = {};
+            resource_desc.Dimension          = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
+            resource_desc.Format             = texture._1;
+            resource_desc.Width              = width;
+            resource_desc.Height             = height;
+            resource_desc.DepthOrArraySize   = 1;
+            resource_desc.MipLevels          = 1;
+            resource_desc.SampleDesc.Count   = 1;
+            resource_desc.SampleDesc.Quality = 0;
+            resource_desc.Layout             = D3D12_TEXTURE_LAYOUT_UNKNOWN;
+            resource_desc.Flags              = D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS;
+
+            CHECK_RESULT(g_device->CreateCommittedResource(
+                &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT), D3D12_HEAP_FLAG_NONE,
+                &resource_desc, D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
+                NULL,
+                IID_PPV_ARGS(texture._0)
+            ));
+        }
+    }
+    if (g_enable) {
+        SET_NAME(g_filtered[0]);
+        SET_NAME(g_filtered[1]);
+        SET_NAME(g_output);
+    }
+}
+
+UINT update_descriptors(DescriptorHandle dest_array, ID3D12Resource* render_target, ID3D12Resource* first_hits, ID3D12Resource* first_hit_albedo) {
+    g_descriptor_table = dest_array;
+
+    Pair<ID3D12Resource*, DXGI_FORMAT> textures[] = { // texture, format of the null descriptor if disabled
+        { render_target,    PIXEL_FORMAT                   },
+        { first_hits,       DXGI_FORMAT_R32G32B32A32_FLOAT },
+        { first_hit_albedo, DXGI_FORMAT_R16G16B16A16_FLOAT },
+        { g_filtered[0],    DXGI_FORMAT_R16G16B16A16_FLOAT },
+        { g_filtered[1],    DXGI_FORMAT_R16G16B16A16_FLOAT },
+        { g_output,         PIXEL_FORMAT                   },
+    };
+    UINT descriptors_count = 0;
+    for (auto& texture : textures) {
+        D3D12_UNORDERED_ACCESS_VIEW_DESC desc = {};
+        desc.Format        = texture._1;
+        desc.ViewDimension = D3D12_UAV_DIMENSION_TEXTURE2D;
+
+        g_device->CreateUnorderedAccessView(texture._0, NULL, &desc, dest_array + descriptors_count);
+        descriptors_count += 1;
+    }
+    return descriptors_count;
+}
+
+ID3D12Resource* denoise(ID3D12GraphicsCommandList* cmd_list, ID3D12Resource* render_target) {
+    if (!g_enable || !g_output) return render_target; // allocated by the next update_resolution after enabling
+
+    D3D12_RESOURCE_DESC desc = render_target->GetDesc();
+    UINT groups_x = ((UINT) desc.Width + DENOISER_GROUP_SIZE - 1) / DENOISER_GROUP_SIZE;
+    UINT groups_y = (desc.Height       + DENOISER_GROUP_SIZE - 1) / DENOISER_GROUP_SIZE;
+
+    cmd_list->SetComputeRootSignature(g_root_signature);
+    cmd_list->SetPipelineState(g_atrous_filter_pso);
+    cmd_list->SetComputeRootDescriptorTable(1, g_descriptor_table);
+
+    // wait for the integrator's writes to the render target and guides
+    cmd_list->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::UAV(NULL));
+
+    DenoiserConstants constants = g_constants;
+    constants.iterations_count = min(max(constants.iterations_count, 1u), (UINT) DENOISER_MAX_ITERATIONS);
+    for (UINT i = 0; i < constants.iterations_count; i++) {
+        constants.iteration = i;
+        cmd_list->SetComputeRoot32BitConstants(0, sizeof(constants) / 4, &constants, 0);
+        cmd_list->Dispatch(groups_x, groups_y, 1);
+        cmd_list->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::UAV(NULL));
+    }
+    return g_output;
+}
+
+} // namespace Denoiser
@@ -0,0 +1,44 @@
+#pragma once
+#include "prelude.h"
+
+// edge-avoiding à-trous wavelet filter of the displayed image, after Dammertz et al. 2010,
+// "Edge-Avoiding À-Trous Wavelet Transform for fast Global Illumination Filtering"
+// each iteration convolves with a 5x5 B3-spline kernel dilated to steps of 2^iteration pixels, weighting the neighbours
+// by the similarity of their color and of the first hit normal, depth and albedo written by the integrator
+
+#ifdef CPP
+#include "device.h"
+
+namespace Denoiser {
+#endif // CPP
+struct DenoiserConstants {
+    COMMON_UINT  iteration;
+    COMMON_UINT  iterations_count;
+    COMMON_FLOAT color_sigma;  // of the displayed color, halved every iteration
+    COMMON_FLOAT normal_power; // of the cosine between the normals
+    COMMON_FLOAT depth_sigma;  // relative to the view depth, per pixel of the kernel's step
+    COMMON_FLOAT albedo_sigma;
+};
+
+#define DENOISER_GROUP_SIZE     8 // threads along each axis of a group, which filters a tile of the image
+#define DENOISER_MAX_ITERATIONS 8
+
+#ifdef CPP
+
+extern bool              g_enable;
+extern bool              g_denoise_captures;
+extern DenoiserConstants g_constants; // iteration is set per dispatch
+
+void init();
+
+// allocate the filter's textures while enabled
+void update_resolution(UINT width, UINT height);
+
+// guides are null while the integrator does not write them
+UINT update_descriptors(DescriptorHandle dest_array, ID3D12Resource* render_target, ID3D12Resource* first_hits, ID3D12Resource* first_hit_albedo);
+
+// filter render_target, returning the texture to display, which is render_target itself while disabled
+ID3D12Resource* denoise(ID3D12GraphicsCommandList* cmd_list, ID3D12Resource* render_target);
+
+} // namespace Denoiser
+#endif // CPP
@@ -0,0 +1,79 @@
+#include "denoiser.h"
+
+// root signature:
+// 0: c
+// 1: { g_render_target, g_first_hits, g_first_hit_albedo, g_filtered[2], g_output }
+#define ROOT_SIG "RootFlags(0)," \
+    "RootConstants(num32BitConstants=6, b0)," \
+    "DescriptorTable(" \
+        "UAV(u0, numDescriptors = 6)" \
+    ")"
+
+ConstantBuffer<DenoiserConstants> c : register(b0);
+
+RWTexture2D<float4> g_render_target    : register(u0); // gamma-encoded, as displayed
+RWTexture2D<float4> g_first_hits       : register(u1); // xyz = normal, w = view depth; 0 on a miss
+RWTexture2D<float4> g_first_hit_albedo : register(u2);
+RWTexture2D<float4> g_filtered[2]      : register(u3); // linear, ping-ponged between iterations
+RWTexture2D<float4> g_output           : register(u5); // gamma-encoded, written by the last iteration
+
+static const float KERNEL[3] = { 3.0/8.0, 1.0/4.0, 1.0/16.0 }; // B3-spline
+
+// linear color of the previous iteration
+float4 load_color(int2 pixel) {
+    if (c.iteration == 0) {
+        float4 color = g_render_target[pixel];
+        return color*color;
+    }
+    return g_filtered[(c.iteration - 1) % 2][pixel];
+}
+
+[numthreads(DENOISER_GROUP_SIZE, DENOISER_GROUP_SIZE, 1)]
+[RootSignature(ROOT_SIG)]
+void atrous_filter(uint3 index : SV_DispatchThreadID) {
+    uint2 dimensions;
+    g_render_target.GetDimensions(dimensions.x, dimensions.y);
+    if (any(index.xy >= dimensions)) return;
+
+    int2   pixel  = index.xy;
+    float4 color  = load_color(pixel);
+    float4 hit    = g_first_hits[pixel];
+    float3 albedo = g_first_hit_albedo[pixel].rgb;
+
+    float4 filtered = color;
+    if (hit.w > 0) { // misses see the background, which needs no filtering
+        int   step        = 1 << c.iteration;
+        float color_sigma = c.color_sigma / step;
+        float depth_sigma = c.depth_sigma * hit.w * step;
+
+        float4 sum     = 0;
+        float  weights = 0;
+        for (int y = -2; y <= 2; y++) {
+            for (int x = -2; x <= 2; x++) {
+                int2 neighbour = pixel + int2(x, y)*step;
+                if (any(neighbour < 0) || any(neighbour >= (int2) dimensions)) continue;
+
+                float4 neighbour_color  = load_color(neighbour);
+                float4 neighbour_hit    = g_first_hits[neighbour];
+                float3 neighbour_albedo = g_first_hit_albedo[neighbour].rgb;
+
+                // edge-stopping functions, compared in gamma space as displayed
+                float3 color_difference  = sqrt(neighbour_color.rgb) - sqrt(color.rgb);
+                float3 albedo_difference = neighbour_albedo - albedo;
+
+                float weight = KERNEL[abs(x)] * KERNEL[abs(y)];
+                weight *= exp(-dot(color_difference, color_difference) / (color_sigma*color_sigma));
+                weight *= pow(max(0, dot(neighbour_hit.xyz, hit.xyz)), c.normal_power);
+                weight *= exp(-abs(neighbour_hit.w - hit.w) / depth_sigma);
+                weight *= exp(-dot(albedo_difference, albedo_difference) / (c.albedo_sigma*c.albedo_sigma));
+
+                sum     += weight * neighbour_color;
+                weights += weight;
+            }
+        }
+        filtered = sum / weights; // the center's weight is positive
+    }
+
+    if (c.iteration + 1 < c.iterations_count) g_filtered[c.iteration % 2][pixel] = filtered;
+    else                                      g_output[pixel] = sqrt(filtered);
+}
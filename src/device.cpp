@@ -30,7 +30,7 @@ void init() {
 
         D3D12_FEATURE_DATA_D3D12_OPTIONS5 options5 = {};
         CHECK_RESULT(g_device->CheckFeatureSupport(D3D12_FEATURE_D3D12_OPTIONS5, &options5, sizeof(options5)));
-        if (options5.RaytracingTier < D3D12_RAYTRACING_TIER_1_0) {
+        if (options5.RaytracingTier < D3D12_RAYTRACING_TIER_1_1) { // inline ray queries and GeometryIndex() of the bssrdf probe rays
             abort();
         }
     }
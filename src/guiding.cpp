@@ -0,0 +1,211 @@
+#include "guiding.h"
+
+namespace Guiding {
+
+// spatial leaves which received more records than this in an iteration are split
+#define SPATIAL_SPLIT_RECORDS 4000
+#define SPATIAL_MAX_NODES     (1 << 16)
+
+// directional quadrants holding more than this fraction of their leaf's energy are subdivided
+#define DIRECTIONAL_SPLIT_FRACTION 0.01f
+// leaves with fewer records keep a uniform directional distribution
+#define DIRECTIONAL_MIN_RECORDS    16
+
+struct DirectionalSample {
+    XMFLOAT2 p;      // on the unit square of cylindrical coordinates
+    float    weight; // radiance over the pdf of its direction
+};
+
+void reset(GuidingTree* tree) {
+    tree->aabb_min = XMFLOAT3( INFINITY,  INFINITY,  INFINITY);
+    tree->aabb_max = XMFLOAT3(-INFINITY, -INFINITY, -INFINITY);
+
+    tree->spatial_nodes.len     = 0;
+    tree->directional_nodes.len = 0;
+    array_push(&tree->spatial_nodes, GuidingSpatialNode { GUIDING_LEAF, 0 });
+    tree->spatial_leaves_count = 1;
+}
+
+// mirrors guiding_find_directional_root in raytracing.hlsl, returning the leaf's index instead
+static UINT find_spatial_leaf(GuidingTree* tree, XMFLOAT3 position) {
+    float p    [3] = { position.x,       position.y,       position.z       };
+    float lower[3] = { tree->aabb_min.x, tree->aabb_min.y, tree->aabb_min.z };
+    float upper[3] = { tree->aabb_max.x, tree->aabb_max.y, tree->aabb_max.z };
+
+    UINT node = 0;
+    while (true) {
+        GuidingSpatialNode spatial = tree->spatial_nodes[node];
+        if (spatial.axis == GUIDING_LEAF) return node;
+
+        float middle = 0.5f * (lower[spatial.axis] + upper[spatial.axis]);
+        if (p[spatial.axis] < middle) { upper[spatial.axis] = middle; node = spatial.child;     }
+        else                          { lower[spatial.axis] = middle; node = spatial.child + 1; }
+    }
+}
+
+static XMFLOAT2 direction_to_square(XMFLOAT3 direction) {
+    float phi = atan2f(direction.y, direction.x) / TAUf;
+    if (phi < 0) phi += 1;
+    return XMFLOAT2(0.5f*(clamp(direction.z, -1, 1) + 1), phi);
+}
+
+// replace the leaf `node` with a complete subtree `levels` deep
+static void split_spatial_leaf(GuidingTree* tree, UINT node, UINT depth, UINT levels) {
+    if (levels == 0 || tree->spatial_nodes.len + 2 > SPATIAL_MAX_NODES) return;
+
+    UINT child = tree->spatial_nodes.len;
+    tree->spatial_nodes[node] = GuidingSpatialNode { depth % 3, child };
+    array_push(&tree->spatial_nodes, GuidingSpatialNode { GUIDING_LEAF, 0 });
+    array_push(&tree->spatial_nodes, GuidingSpatialNode { GUIDING_LEAF, 0 });
+    tree->spatial_leaves_count += 1;
+
+    split_spatial_leaf(tree, child,     depth + 1, levels - 1);
+    split_spatial_leaf(tree, child + 1, depth + 1, levels - 1);
+}
+
+static void refine_spatial_tree(GuidingTree* tree, ArrayView<GuidingRecord> records) {
+    // depth of each node, to cycle the split axes; children are always pushed after their parent
+    Array<UINT> depths = array_init<UINT>(tree->spatial_nodes.len);
+    array_push(&depths, 0u);
+    for (UINT i = 0; i < tree->spatial_nodes.len; i++) {
+        if (tree->spatial_nodes[i].axis == GUIDING_LEAF) continue;
+        UINT child = tree->spatial_nodes[i].child;
+        while (depths.len < child + 2) array_push(&depths, 0u);
+        depths[child]     = depths[i] + 1;
+        depths[child + 1] = depths[i] + 1;
+    }
+
+    Array<UINT> counts = array_init<UINT>(tree->spatial_nodes.len);
+    for (UINT i = 0; i < tree->spatial_nodes.len; i++) array_push(&counts, 0u);
+    for (auto& record : records) counts[find_spatial_leaf(tree, record.position)] += 1;
+
+    // split the leaves, assuming their records spread evenly between the halves of each split
+    UINT nodes_count = tree->spatial_nodes.len;
+    for (UINT i = 0; i < nodes_count; i++) {
+        if (tree->spatial_nodes[i].axis != GUIDING_LEAF) continue;
+
+        UINT levels = 0;
+        while ((counts[i] >> levels) > SPATIAL_SPLIT_RECORDS) levels += 1;
+        split_spatial_leaf(tree, i, depths[i], levels);
+    }
+
+    array_free(&depths);
+    array_free(&counts);
+}
+
+// partition `samples` in place by the quadrant of `middle` they fall into, returning the view of each quadrant
+static void partition_quadrants(ArrayView<DirectionalSample> samples, XMFLOAT2 middle, ArrayView<DirectionalSample> quadrants[4]) {
+    size_t begin = 0;
+    for (UINT q = 0; q < 4; q++) {
+        size_t end = begin;
+        for (size_t j = begin; j < samples.len; j++) {
+            XMFLOAT2 p = samples[j].p;
+            UINT quadrant = (p.x >= middle.x) + 2*(p.y >= middle.y);
+            if (quadrant == q) Prelude::swap(&samples[j], &samples[end++]);
+        }
+        quadrants[q] = array_from(samples.ptr + begin, end - begin);
+        begin = end;
+    }
+}
+
+static UINT build_directional_tree(GuidingTree* tree, ArrayView<DirectionalSample> samples, XMFLOAT2 origin, float size, UINT depth, float leaf_energy) {
+    UINT index = tree->directional_nodes.len;
+    array_push_default(&tree->directional_nodes);
+
+    float half = 0.5f*size;
+    ArrayView<DirectionalSample> quadrants[4];
+    partition_quadrants(samples, XMFLOAT2(origin.x + half, origin.y + half), quadrants);
+
+    float energy[4] = {};
+    for (UINT q = 0; q < 4; q++) {
+        for (auto& sample : quadrants[q]) energy[q] += sample.weight;
+    }
+
+    GuidingDirectionalNode node = {};
+    node.energy = XMFLOAT4(energy[0], energy[1], energy[2], energy[3]);
+
+    UINT children[4] = {};
+    for (UINT q = 0; q < 4; q++) {
+        if (depth + 1 >= GUIDING_MAX_DEPTH || quadrants[q].len < 2 || energy[q] <= DIRECTIONAL_SPLIT_FRACTION*leaf_energy) continue;
+
+        XMFLOAT2 quadrant_origin = XMFLOAT2(origin.x + half*(q % 2), origin.y + half*(q / 2));
+        children[q] = build_directional_tree(tree, quadrants[q], quadrant_origin, half, depth + 1, leaf_energy);
+    }
+    node.child = XMUINT4(children[0], children[1], children[2], children[3]);
+
+    tree->directional_nodes[index] = node; // pushes by the children may have moved the array
+    return index;
+}
+
+void train(GuidingTree* tree, ArrayView<GuidingRecord> records) {
+    if (tree->aabb_min.x > tree->aabb_max.x) {
+        XMVECTOR lower = g_XMInfinity, upper = g_XMNegInfinity;
+        for (auto& record : records) {
+            XMVECTOR p = XMLoadFloat3(&record.position);
+            lower = XMVectorMin(lower, p);
+            upper = XMVectorMax(upper, p);
+        }
+        if (!records.len) lower = upper = XMVectorZero();
+
+        // pad so that points on the bounds fall inside
+        XMVECTOR padding = XMVectorReplicate(0.01f) * (upper - lower) + XMVectorReplicate(FLT_EPSILON);
+        XMStoreFloat3(&tree->aabb_min, lower - padding);
+        XMStoreFloat3(&tree->aabb_max, upper + padding);
+    }
+
+    refine_spatial_tree(tree, records);
+
+    // bucket the records by spatial leaf
+    Array<UINT> offsets = array_init<UINT>(tree->spatial_nodes.len + 1);
+    for (UINT i = 0; i <= tree->spatial_nodes.len; i++) array_push(&offsets, 0u);
+
+    Array<UINT> leaves = array_init<UINT>(records.len);
+    for (auto& record : records) {
+        UINT leaf = find_spatial_leaf(tree, record.position);
+        array_push(&leaves, leaf);
+        offsets[leaf + 1] += 1;
+    }
+    for (UINT i = 0; i < tree->spatial_nodes.len; i++) offsets[i + 1] += offsets[i];
+
+    Array<DirectionalSample> samples = array_init<DirectionalSample>(records.len);
+    samples.len = records.len;
+    {
+        Array<UINT> cursors = array_init<UINT>(tree->spatial_nodes.len);
+        for (UINT i = 0; i < tree->spatial_nodes.len; i++) array_push(&cursors, offsets[i]);
+
+        for (UINT i = 0; i < records.len; i++) {
+            GuidingRecord record = records[i];
+
+            DirectionalSample sample = {};
+            sample.p = direction_to_square(record.direction);
+            if (record.pdf > 0 && isfinite(record.radiance)) sample.weight = max(0.0f, record.radiance) / record.pdf;
+
+            samples[cursors[leaves[i]]++] = sample;
+        }
+        array_free(&cursors);
+    }
+
+    // rebuild the directional trees
+    tree->directional_nodes.len = 0;
+    for (UINT i = 0; i < tree->spatial_nodes.len; i++) {
+        if (tree->spatial_nodes[i].axis != GUIDING_LEAF) continue;
+
+        ArrayView<DirectionalSample> leaf_samples = array_from(samples.ptr + offsets[i], offsets[i + 1] - offsets[i]);
+
+        float leaf_energy = 0;
+        for (auto& sample : leaf_samples) leaf_energy += sample.weight;
+
+        if (leaf_samples.len < DIRECTIONAL_MIN_RECORDS || leaf_energy <= 0) {
+            tree->spatial_nodes[i].child = tree->directional_nodes.len;
+            array_push_default(&tree->directional_nodes); // uniform
+            continue;
+        }
+        tree->spatial_nodes[i].child = build_directional_tree(tree, leaf_samples, XMFLOAT2(0, 0), 1, 0, leaf_energy);
+    }
+
+    array_free(&offsets);
+    array_free(&leaves);
+    array_free(&samples);
+}
+
+} // namespace Guiding
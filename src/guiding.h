@@ -0,0 +1,33 @@
+#pragma once
+#include "prelude.h"
+
+// path guiding distributions, sampled in raytracing.hlsl
+// a binary spatial tree over the scene with a directional quadtree per leaf, trained on the host from the radiance
+// records of the previous iteration, after Müller et al. 2017, "Practical Path Guiding for Efficient Light-Transport Simulation"
+struct GuidingTree {
+    XMFLOAT3 aabb_min;
+    XMFLOAT3 aabb_max;
+
+    Array<GuidingSpatialNode>     spatial_nodes;
+    Array<GuidingDirectionalNode> directional_nodes;
+    UINT                          spatial_leaves_count;
+};
+
+// training statistics of one iteration
+struct GuidingIteration {
+    UINT   frames;
+    UINT   records_count;
+    UINT   spatial_leaves_count;
+    UINT   directional_nodes_count;
+    double pixel_variance; // mean over the iteration's frames, 0 if not measured
+};
+
+namespace Guiding {
+
+void reset(GuidingTree* tree);
+
+// refine the spatial tree by record counts and rebuild the directional trees from the records' energy
+// the first iteration also fits the spatial tree's bounds to the records
+void train(GuidingTree* tree, ArrayView<GuidingRecord> records);
+
+} // namespace Guiding
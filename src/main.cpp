@@ -9,6 +9,7 @@ using Device::g_rtv_descriptor_size;
 #include "parse_obj.h"
 #include "raytracing.h"
 #include "bluenoise.h"
+#include "denoiser.h"
 
 #define SCENE_NAME "final"
 
@@ -51,9 +52,24 @@ float g_do_regenerate_translucent_samples = 0.025;
 float g_sample_points_radius = 0;
 UINT g_total_sample_points = 0;
 UINT g_prevent_resizing = 0;
+UINT g_requested_aovs = 0; // AOV_*, besides those the denoiser needs
+
+// incremented by input which raises a reset of the frame's samples, for stale frames to be cancelled
+UINT64 g_input_generation = 0;
+UINT64 g_frame_generation = 0; // at the start of the current frame
+bool   g_editing_render     = false; // the active widget of the debug menu raised a reset in the last frame
 
 // UTILITY FUNCTIONS
 
+// the denoiser's descriptors follow the raytracing descriptors, whose count varies with the translucent sample points
+void update_descriptors() {
+    UINT raytracing_descriptors_count = Raytracing::update_descriptors({ g_descriptor_heap, RAYTRACING_DESCRIPTOR_INDEX });
+    Denoiser::update_descriptors(
+        { g_descriptor_heap, RAYTRACING_DESCRIPTOR_INDEX + raytracing_descriptors_count },
+        Raytracing::g_render_target, Raytracing::g_first_hits, Raytracing::g_first_hit_albedo
+    );
+}
+
 void update_resolution() {
     { // get client area
         RECT rect;
@@ -102,8 +118,32 @@ void update_resolution() {
         }
     }
 
+    Raytracing::g_aovs = g_requested_aovs;
+    if (Denoiser::g_enable) Raytracing::g_aovs |= AOV_NORMAL_DEPTH | AOV_ALBEDO; // guides of the denoiser
     Raytracing::update_resolution(g_width, g_height);
-    Raytracing::update_descriptors({ g_descriptor_heap, RAYTRACING_DESCRIPTOR_INDEX });
+    Denoiser::update_resolution(g_width, g_height);
+    update_descriptors();
+}
+
+// passed to Raytracing::dispatch_rays: submit the frame's commands so far, then handle the input which arrived meanwhile
+bool flush_frame(ID3D12GraphicsCommandList4* cmd_list) {
+    CHECK_RESULT(cmd_list->Close());
+    g_cmd_queue->ExecuteCommandLists(1, (ID3D12CommandList**) &cmd_list);
+    Fence::increment_and_signal_and_wait(g_cmd_queue, &g_fence);
+
+    CHECK_RESULT(cmd_list->Reset(g_cmd_allocator, NULL));
+    cmd_list->SetDescriptorHeaps(1, &g_descriptor_heap);
+
+    MSG msg = {};
+    while (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE)) {
+        if (msg.message == WM_QUIT) {
+            PostQuitMessage((int) msg.wParam); // left for the main loop
+            return true;
+        }
+        TranslateMessage(&msg);
+        DispatchMessage(&msg);
+    }
+    return g_input_generation != g_frame_generation;
 }
 
 LRESULT CALLBACK WindowProc(
@@ -112,6 +152,22 @@ LRESULT CALLBACK WindowProc(
     WPARAM wp,
     LPARAM lp
 ) {
+    // dragging or scrolling outside the debug menu moves the camera, and within it edits the active widget, which only
+    // counts if that widget raised a reset before; clicks, hovering and moving the menu leave the frame's parameters alone
+    switch (msg) {
+        case WM_MOUSEMOVE: case WM_MOUSEWHEEL: {
+            bool dragging = msg == WM_MOUSEWHEEL || (wp & (MK_LBUTTON | MK_RBUTTON | MK_MBUTTON));
+            bool camera   = ImGui::GetCurrentContext() && !ImGui::GetIO().WantCaptureMouse;
+            if (dragging && (camera || g_editing_render)) g_input_generation += 1;
+        } break;
+        case WM_KEYDOWN: case WM_CHAR: {
+            if (g_editing_render) g_input_generation += 1;
+        } break;
+        case WM_SIZE: {
+            g_input_generation += 1; // resets the accumulator with the resolution
+        } break;
+    }
+
     if (ImGui_ImplWin32_WndProcHandler(g_hwnd, msg, wp, lp)) return 0;
 
     switch (msg) {
@@ -215,6 +271,7 @@ int WINAPI wWinMain(
 
     Bluenoise::init();
     Raytracing::init(cmd_list);
+    Denoiser::init();
 
     // SETUP
 
@@ -412,6 +469,12 @@ int WINAPI wWinMain(
 
     Raytracing::g_globals.samples_per_pixel  = 1;
     Raytracing::g_globals.bounces_per_sample = 4;
+    Raytracing::g_globals.roulette_min_bounces = 2;
+    Raytracing::g_globals.split_threshold      = 0.0;
+    Raytracing::g_globals.radiance_cache_depth       = 0;
+    Raytracing::g_globals.radiance_cache_cell_size   = 0.02;
+    Raytracing::g_globals.radiance_cache_min_samples = 16;
+    Raytracing::g_globals.reprojection_max_samples   = 64;
     Raytracing::g_globals.translucent_emission_bounces = 1;
 
     // Raytracing::g_globals.translucent_bssrdf_scale = 0.4;
@@ -420,6 +483,7 @@ int WINAPI wWinMain(
     Raytracing::g_globals.translucent_refractive_index = 1.75;
     Raytracing::g_globals.translucent_scattering = XMFLOAT3(15.0, 15.0, 15.0);
     Raytracing::g_globals.translucent_absorption = XMFLOAT3(0.1, 0.1, 0.1);
+    Raytracing::g_globals.translucent_octree_error = 0.05;
 
     // MAIN LOOP
 
@@ -435,10 +499,13 @@ int WINAPI wWinMain(
             DispatchMessage(&msg);
         }
 
+        g_frame_generation = g_input_generation;
+
         // synchronize with g_device
         // TODO: pipeline frames
         Fence::increment_and_signal_and_wait(g_cmd_queue, &g_fence);
         Device::release_temp_resources();
+        if (frame_id > 0) Raytracing::read_frame_statistics(g_cmd_queue);
 
         { // generate new rng seed for frame
             UINT rng = Raytracing::g_globals.frame_rng;
@@ -462,15 +529,16 @@ int WINAPI wWinMain(
         // poll mouse input
         XMFLOAT2 mouse_drag = {};
         float    mouse_scroll = 0;
+        bool     camera_moved = false;
         if (!io.WantCaptureMouse) {
             if (ImGui::IsMouseDragging(0)) {
                 mouse_drag.x = (float) io.MouseDelta.x / (float) g_width;
                 mouse_drag.y =-(float) io.MouseDelta.y / (float) g_width;
-                g_do_reset_accumulator = true;
+                camera_moved = true;
             }
             if (io.MouseWheel) {
                 mouse_scroll = io.MouseWheel;
-                g_do_reset_accumulator = true;
+                camera_moved = true;
             };
         }
 
@@ -502,25 +570,25 @@ int WINAPI wWinMain(
                 target[2] = -0.06;
                 fov_y = 30*DEGREES;
                 fov_x = fov_y * g_aspect;
-                g_do_reset_accumulator = true;
+                camera_moved = true;
             }
 
-            g_do_reset_accumulator |= ImGui::SliderAngle("azimuth##camera",   &azimuth);
+            camera_moved |= ImGui::SliderAngle("azimuth##camera",   &azimuth);
             azimuth += mouse_drag.x * TAU/2;
             azimuth = fmod(azimuth + 3*TAU/2, TAU) - TAU/2;
 
-            g_do_reset_accumulator |= ImGui::SliderAngle("elevation##camera", &elevation, -85, 85);
+            camera_moved |= ImGui::SliderAngle("elevation##camera", &elevation, -85, 85);
             elevation -= mouse_drag.y * TAU/2;
             elevation = clamp(elevation, -85*DEGREES, 85*DEGREES);
 
-            g_do_reset_accumulator |= ImGui::DragFloat("distance##camera", &distance, distance*0.005, 0.001, FLT_MAX);
+            camera_moved |= ImGui::DragFloat("distance##camera", &distance, distance*0.005, 0.001, FLT_MAX);
             distance -= mouse_scroll*distance*0.05;
             distance = clamp(distance, 0.005, INFINITY);
 
-            g_do_reset_accumulator |= ImGui::SliderFloat3("focus##camera", target, -1, 1);
+            camera_moved |= ImGui::SliderFloat3("focus##camera", target, -1, 1);
 
-            if (ImGui::SliderAngle("fov x##camera", &fov_x, 5,          175))          { fov_y = fov_x / g_aspect; g_do_reset_accumulator = true; }
-            if (ImGui::SliderAngle("fov y##camera", &fov_y, 5/g_aspect, 175/g_aspect)) { fov_x = fov_y * g_aspect; g_do_reset_accumulator = true; }
+            if (ImGui::SliderAngle("fov x##camera", &fov_x, 5,          175))          { fov_y = fov_x / g_aspect; camera_moved = true; }
+            if (ImGui::SliderAngle("fov y##camera", &fov_y, 5/g_aspect, 175/g_aspect)) { fov_x = fov_y * g_aspect; camera_moved = true; }
 
             XMVECTOR focus = XMLoadFloat3((XMFLOAT3*) target);
             XMVECTOR camera_pos = focus + XMVectorSet(
@@ -533,6 +601,14 @@ int WINAPI wWinMain(
             Raytracing::g_globals.camera_focal_length = 1 / tanf(fov_y/2);
             XMMATRIX view = XMMatrixLookAtRH(camera_pos, focus, g_XMIdentityR2);
             XMStoreFloat4x4(&Raytracing::g_globals.camera_to_world, XMMatrixInverse(NULL, view));
+
+            // with dynamic resolution, motion is previewed at a reduced resolution, which refines once it stops
+            // otherwise with reprojection, the accumulated samples are warped into the new view
+            Raytracing::g_interacting = camera_moved && Raytracing::g_enable_dynamic_resolution;
+            if (camera_moved) {
+                if (Raytracing::g_enable_reprojection && !Raytracing::g_interacting) Raytracing::g_reproject_accumulator = true;
+                else                                                                 g_do_reset_accumulator              = true;
+            }
         }
 
         { // light source
@@ -541,10 +617,25 @@ int WINAPI wWinMain(
 
             static float light_hue[3] = { 1.0, 1.0, 1.0 };
             static float light_brightness = 50.0;
-            g_do_reset_translucent_accumulator |= ImGui::DragFloat("brightness##light", &light_brightness, 0.5, 0.0, 1000.0, "%.3f", ImGuiSliderFlags_Logarithmic);
-            g_do_reset_translucent_accumulator |= ImGui::ColorEdit3("hue##light", light_hue);
-
-            Raytracing::g_globals.light_color = { light_hue[0] * light_brightness, light_hue[1] * light_brightness, light_hue[2] * light_brightness };
+            bool light_changed = false;
+            light_changed |= ImGui::DragFloat("brightness##light", &light_brightness, 0.5, 0.0, 1000.0, "%.3f", ImGuiSliderFlags_Logarithmic);
+            light_changed |= ImGui::ColorEdit3("hue##light", light_hue);
+
+            // accumulate radiance for a unit light and scale it by the light color at display, so that editing the light is free
+            // emitters with colors of their own do not scale with the light color
+            static bool light_linear = true;
+            g_do_reset_translucent_accumulator |= ImGui::Checkbox("light-linear accumulation##light", &light_linear);
+            bool linear = light_linear && !Raytracing::g_fixed_color_emitters;
+            g_do_reset_translucent_accumulator |= light_changed && !linear;
+
+            XMFLOAT3 light_color = { light_hue[0] * light_brightness, light_hue[1] * light_brightness, light_hue[2] * light_brightness };
+            Raytracing::g_globals.light_color = linear ? XMFLOAT3(1, 1, 1) : light_color;
+            Raytracing::g_globals.light_scale = linear ? light_color : XMFLOAT3(1, 1, 1);
+
+            static bool light_sampling = true;
+            g_do_reset_translucent_accumulator |= ImGui::Checkbox("explicit sampling##light", &light_sampling);
+            Raytracing::g_globals.light_sampling = light_sampling;
+            ImGui::Text("emitter triangles: %d", Raytracing::g_globals.emitters_count);
         }
 
         { // translucent material
@@ -560,6 +651,10 @@ int WINAPI wWinMain(
             if (ImGui::RadioButton("dipole",    Raytracing::g_globals.translucent_bssrdf_scale == 0)) { Raytracing::g_globals.translucent_bssrdf_scale = 0;     g_do_reset_accumulator = true; };
 
             g_do_reset_translucent_accumulator |= ImGui::SliderFloat("refractive index##translucent", &Raytracing::g_globals.translucent_refractive_index, 1.0, 5.0, "%.3f", ImGuiSliderFlags_Logarithmic | ImGuiSliderFlags_AlwaysClamp);
+            g_do_reset_accumulator |= ImGui::SliderInt("probe rays, direct light only##translucent", (int*) &Raytracing::g_globals.translucent_probes, 0, 16, Raytracing::g_globals.translucent_probes ? "%d" : "sample points", ImGuiSliderFlags_AlwaysClamp);
+            g_do_reset_accumulator |= ImGui::SliderFloat("octree error##translucent", &Raytracing::g_globals.translucent_octree_error, 0.0, 1.0, "%.3f", ImGuiSliderFlags_Logarithmic | ImGuiSliderFlags_AlwaysClamp);
+            g_do_reset_accumulator |= ImGui::SliderFloat("cutoff tolerance##translucent", &Raytracing::g_translucent_cutoff_tolerance, 0.0, 0.1, "%.6f", ImGuiSliderFlags_Logarithmic | ImGuiSliderFlags_AlwaysClamp);
+            ImGui::Text("cutoff radius: %.3f", Raytracing::g_globals.translucent_cutoff_radius);
 
             if (Raytracing::g_globals.translucent_bssrdf_scale != 0) {
                 // tabulated
@@ -581,6 +676,9 @@ int WINAPI wWinMain(
 
                 Raytracing::g_globals.translucent_scattering = { scattering_hue[0] * scattering, scattering_hue[1] * scattering, scattering_hue[2] * scattering };
                 Raytracing::g_globals.translucent_absorption = { absorption_hue[0] * absorption, absorption_hue[1] * absorption, absorption_hue[2] * absorption };
+
+                g_do_reset_accumulator |= ImGui::Checkbox("profile table##translucent", &Raytracing::g_enable_dipole_lut);
+                ImGui::SameLine(); ImGui::Text("error: %.2e of peak", Raytracing::g_dipole_lut_error);
             }
         }
 
@@ -592,11 +690,24 @@ int WINAPI wWinMain(
             static float sample_point_radius = g_do_regenerate_translucent_samples;
             ImGui::SliderFloat("radius##sample_points", &sample_point_radius, 0.005, 0.5, "%.3f", ImGuiSliderFlags_Logarithmic);
 
+            ImGui::Checkbox("morton order##sample_points", &Raytracing::g_morton_order_sample_points); ImGui::SameLine();
+            ImGui::Checkbox("compact##sample_points", &Raytracing::g_compact_sample_points);
+            if (Raytracing::g_globals.translucent_compact_samples) {
+                ImGui::Text("position error: %.2e, payload error: %.2e of largest channel", Raytracing::g_compact_position_error, Raytracing::g_compact_payload_error);
+            }
+
             if (ImGui::Button("regenerate##sample_points")) { g_do_regenerate_translucent_samples = sample_point_radius; } ImGui::SameLine();
             g_do_reset_translucent_accumulator |= ImGui::Button("reset##sample_points");
 
+            g_do_reset_translucent_accumulator |= ImGui::Checkbox("photons##sample_points", &Raytracing::g_enable_translucent_photons);
+            if (Raytracing::g_enable_translucent_photons) {
+                g_do_reset_translucent_accumulator |= ImGui::SliderInt("photons per frame##sample_points", (int*) &Raytracing::g_translucent_photons_count, 1, 1 << 22, "%d", ImGuiSliderFlags_Logarithmic | ImGuiSliderFlags_AlwaysClamp);
+            } else {
+                ImGui::SliderInt("ray budget##sample_points", (int*) &Raytracing::g_translucent_ray_budget, 0, 1 << 22, Raytracing::g_translucent_ray_budget ? "%d" : "unlimited", ImGuiSliderFlags_Logarithmic | ImGuiSliderFlags_AlwaysClamp);
+            }
+
             ImGui::Text("total sample points: %d", g_total_sample_points);
-            ImGui::Text("accumulated samples: %d", Raytracing::g_globals.translucent_accumulator_count);
+            ImGui::Text("accumulated samples: %d, points per instance and frame: %d", Raytracing::g_globals.translucent_accumulator_count, Raytracing::g_translucent_update_window);
         }
 
         { // render settings
@@ -619,21 +730,111 @@ int WINAPI wWinMain(
             }
 
             g_do_reset_accumulator |= ImGui::SliderInt("samples##render", (int*) &Raytracing::g_globals.samples_per_pixel,  1, 64, "%d", ImGuiSliderFlags_AlwaysClamp);
-            g_do_reset_accumulator |= ImGui::SliderInt("bounces##render", (int*) &Raytracing::g_globals.bounces_per_sample, 0, 16, "%d", ImGuiSliderFlags_AlwaysClamp);
+            if (ImGui::SliderInt("bounces##render", (int*) &Raytracing::g_globals.bounces_per_sample, 0, 16, "%d", ImGuiSliderFlags_AlwaysClamp)) {
+                g_do_reset_accumulator = true;
+                Raytracing::g_clear_radiance_cache = true; // cached radiance depends on the remaining bounces
+            }
+            g_do_reset_accumulator |= ImGui::SliderInt("roulette depth##render", (int*) &Raytracing::g_globals.roulette_min_bounces, 0, 16, "%d", ImGuiSliderFlags_AlwaysClamp);
+            // wavefront paths are neither split nor cached, see raytracing.hlsl
+            bool wavefront = Raytracing::g_enable_wavefront && !Raytracing::g_enable_bidirectional;
+            if (wavefront) ImGui::Text("splitting, radiance cache: not in the wavefront integrator");
+            else           g_do_reset_accumulator |= ImGui::SliderFloat("split threshold##render", &Raytracing::g_globals.split_threshold, 0.0, 1.0, "%.3f", ImGuiSliderFlags_AlwaysClamp);
+
+            if (!wavefront) { // radiance cache
+                bool changed = false;
+                changed |= ImGui::SliderInt("cache depth##render", (int*) &Raytracing::g_globals.radiance_cache_depth, 0, 16, Raytracing::g_globals.radiance_cache_depth ? "%d" : "disabled", ImGuiSliderFlags_AlwaysClamp);
+                changed |= ImGui::SliderFloat("cache cell size##render", &Raytracing::g_globals.radiance_cache_cell_size, 0.002, 0.2, "%.3f", ImGuiSliderFlags_Logarithmic | ImGuiSliderFlags_AlwaysClamp);
+                g_do_reset_accumulator |= ImGui::SliderInt("cache min samples##render", (int*) &Raytracing::g_globals.radiance_cache_min_samples, 1, 1024, "%d", ImGuiSliderFlags_Logarithmic | ImGuiSliderFlags_AlwaysClamp);
+                changed |= ImGui::Button("reset##radiance_cache");
+
+                g_do_reset_accumulator |= changed;
+                Raytracing::g_clear_radiance_cache |= changed;
+            }
+
+            static bool low_discrepancy_sampling = true;
+            g_do_reset_translucent_accumulator |= ImGui::Checkbox("low-discrepancy sampling##render", &low_discrepancy_sampling);
+            Raytracing::g_globals.low_discrepancy_sampling = low_discrepancy_sampling;
 
             static bool accumulator = true;
             ImGui::Checkbox("sample accumulation##render", &accumulator);
             g_do_reset_accumulator |= !accumulator;
+
+            // path state and reprojection buffers are allocated with the render targets
+            g_do_update_resolution |= ImGui::Checkbox("reprojection##render", &Raytracing::g_enable_reprojection);
+            if (Raytracing::g_enable_reprojection) {
+                ImGui::SliderInt("reprojected samples##render", (int*) &Raytracing::g_globals.reprojection_max_samples, 1, 4096, "%d", ImGuiSliderFlags_Logarithmic | ImGuiSliderFlags_AlwaysClamp);
+            }
+            // first hit AOVs are allocated with the render targets, for compositing
+            ImGui::Text("first hit AOVs:"); ImGui::SameLine();
+            g_do_update_resolution |= ImGui::CheckboxFlags("normal, depth##aovs", &g_requested_aovs, AOV_NORMAL_DEPTH); ImGui::SameLine();
+            g_do_update_resolution |= ImGui::CheckboxFlags("albedo##aovs",        &g_requested_aovs, AOV_ALBEDO);       ImGui::SameLine();
+            g_do_update_resolution |= ImGui::CheckboxFlags("ids##aovs",           &g_requested_aovs, AOV_IDS);
+            g_do_reset_accumulator |= ImGui::Checkbox("progressive refinement##render", &Raytracing::g_enable_progressive_refinement);
+            ImGui::Checkbox("dynamic resolution##render", &Raytracing::g_enable_dynamic_resolution);
+            if (Raytracing::g_enable_dynamic_resolution) {
+                ImGui::SliderFloat("interaction budget##render", &Raytracing::g_interaction_budget_milliseconds, 1, 100, "%.1f ms", ImGuiSliderFlags_Logarithmic | ImGuiSliderFlags_AlwaysClamp);
+            }
+            ImGui::SliderInt("frame tiles##render", (int*) &Raytracing::g_frame_tiles, 1, 16, "%d", ImGuiSliderFlags_AlwaysClamp); // frames may be cancelled between tiles
+            g_do_update_resolution |= ImGui::Checkbox("wavefront integrator##render", &Raytracing::g_enable_wavefront);
+            g_do_reset_accumulator |= ImGui::Checkbox("bidirectional integrator##render", &Raytracing::g_enable_bidirectional); // takes precedence over wavefront
+
+            ImGui::Text("render time: %.3f ms", Raytracing::g_render_milliseconds);
+            if (Raytracing::g_globals.render_scale > 1) { ImGui::SameLine(); ImGui::Text("(1/%d resolution)", Raytracing::g_globals.render_scale); }
+            ImGui::Text("rays per sample: %.2f", Raytracing::g_rays_per_sample);
+            ImGui::Text("cancelled frames: %d", Raytracing::g_cancelled_frames_count);
+            if (Raytracing::g_globals.samples_per_pixel > 1) ImGui::Text("pixel variance: %.5f", Raytracing::g_pixel_variance);
+            else                                             ImGui::Text("pixel variance: needs 2+ samples");
+        }
+
+        { // denoiser
+            ImGui::Separator();
+            ImGui::Text("denoiser"); ImGui::SameLine();
+            g_do_update_resolution |= ImGui::Checkbox("enabled##denoiser", &Denoiser::g_enable); // allocates the filter and its guides
+            if (Denoiser::g_enable) {
+                ImGui::SliderInt  ("iterations##denoiser",   (int*) &Denoiser::g_constants.iterations_count, 1, DENOISER_MAX_ITERATIONS, "%d", ImGuiSliderFlags_AlwaysClamp);
+                ImGui::SliderFloat("color sigma##denoiser",  &Denoiser::g_constants.color_sigma,  0.01, 10.0, "%.3f", ImGuiSliderFlags_Logarithmic | ImGuiSliderFlags_AlwaysClamp);
+                ImGui::SliderFloat("normal power##denoiser", &Denoiser::g_constants.normal_power, 1.0, 256.0, "%.1f", ImGuiSliderFlags_Logarithmic | ImGuiSliderFlags_AlwaysClamp);
+                ImGui::SliderFloat("depth sigma##denoiser",  &Denoiser::g_constants.depth_sigma,  0.001, 1.0, "%.3f", ImGuiSliderFlags_Logarithmic | ImGuiSliderFlags_AlwaysClamp);
+                ImGui::SliderFloat("albedo sigma##denoiser", &Denoiser::g_constants.albedo_sigma, 0.01, 10.0, "%.3f", ImGuiSliderFlags_Logarithmic | ImGuiSliderFlags_AlwaysClamp);
+                ImGui::Checkbox("denoise captures##denoiser", &Denoiser::g_denoise_captures);
+            }
+        }
+
+        { // path guiding
+            ImGui::Separator();
+            ImGui::Text("path guiding"); ImGui::SameLine();
+            g_do_reset_accumulator |= ImGui::Checkbox("enabled##guiding", &Raytracing::g_enable_guiding);
+            if (Raytracing::g_enable_wavefront && !Raytracing::g_enable_bidirectional) {
+                ImGui::SameLine(); ImGui::Text("(not trained by the wavefront integrator)");
+            }
+            if (ImGui::Button("retrain##guiding")) {
+                Raytracing::g_reset_guiding = true;
+                g_do_reset_accumulator = true;
+            }
+
+            // iteration 0 is rendered before any distribution has been trained
+            auto& report = Raytracing::g_guiding_report;
+            for (UINT i = 0; i < report.len; i++) {
+                GuidingIteration* it = &report[i];
+                ImGui::Text("iteration %d: %d frames, %d records, %d leaves, %d nodes", i, it->frames, it->records_count, it->spatial_leaves_count, it->directional_nodes_count);
+                if (report[0].pixel_variance > 0 && it->pixel_variance > 0) {
+                    ImGui::Text("    variance %.5f (%.2fx lower than iteration 0)", it->pixel_variance, report[0].pixel_variance / it->pixel_variance);
+                }
+            }
         }
 
         // PRE-RENDER
 
+        // input to the widget being edited will likely change the render again while this frame is traced
+        bool render_changed = g_do_reset_accumulator || g_do_reset_translucent_accumulator || g_do_update_resolution || g_do_regenerate_translucent_samples || Raytracing::g_reproject_accumulator;
+        g_editing_render = render_changed && ImGui::IsAnyItemActive();
+
         // translucent samples
         if (g_do_regenerate_translucent_samples) {
             CHECK_RESULT(cmd_list->Reset(g_cmd_allocator, NULL));
 
             g_total_sample_points = Raytracing::generate_translucent_samples(cmd_list, g_do_regenerate_translucent_samples, NULL);
-            Raytracing::update_descriptors({ g_descriptor_heap, RAYTRACING_DESCRIPTOR_INDEX });
+            update_descriptors();
 
             CHECK_RESULT(cmd_list->Close());
             g_cmd_queue->ExecuteCommandLists(1, (ID3D12CommandList**) &cmd_list);
@@ -649,11 +850,15 @@ int WINAPI wWinMain(
         if (g_do_reset_translucent_accumulator) {
             g_do_reset_accumulator = true;
             Raytracing::g_globals.translucent_accumulator_count = 0;
+            Raytracing::g_globals.translucent_sampler_seed      = Raytracing::g_globals.frame_rng;
+            Raytracing::g_clear_radiance_cache = true; // lighting or materials changed
+            Raytracing::g_reset_guiding        = true;
             g_do_reset_translucent_accumulator = false;
         }
 
         if (g_do_reset_accumulator) {
             Raytracing::g_globals.accumulator_count  = 0;
+            Raytracing::g_globals.sampler_seed       = Raytracing::g_globals.frame_rng; // rescramble the sequence
             g_do_reset_accumulator = false;
         }
 
@@ -666,13 +871,17 @@ int WINAPI wWinMain(
         cmd_list->SetDescriptorHeaps(1, &g_descriptor_heap);
 
         // raytracing
-        Raytracing::dispatch_rays(cmd_list);
+        Raytracing::dispatch_rays(cmd_list, flush_frame);
+
+        // denoising
+        ID3D12Resource* denoised = Denoiser::denoise(cmd_list, Raytracing::g_render_target);
 
         // copy raytracing output to backbuffer
         cmd_list->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(Raytracing::g_render_target, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_SOURCE));
+        if (denoised != Raytracing::g_render_target) cmd_list->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(denoised, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_SOURCE));
         cmd_list->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(g_rtvs[backbuffer_index], D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_COPY_DEST));
 
-        cmd_list->CopyResource(g_rtvs[backbuffer_index], Raytracing::g_render_target);
+        cmd_list->CopyResource(g_rtvs[backbuffer_index], denoised);
 
         { // image capture
             ImGui::Separator();
@@ -720,7 +929,7 @@ int WINAPI wWinMain(
                 dst.PlacedFootprint.Footprint.RowPitch = capture_readback_buffer_pitch;
 
                 D3D12_TEXTURE_COPY_LOCATION src = {};
-                src.pResource = Raytracing::g_render_target;
+                src.pResource = Denoiser::g_denoise_captures ? denoised : Raytracing::g_render_target;
                 src.Type      = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
                 src.SubresourceIndex = 0;
 
@@ -767,6 +976,7 @@ int WINAPI wWinMain(
         }
 
         cmd_list->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(Raytracing::g_render_target, D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS));
+        if (denoised != Raytracing::g_render_target) cmd_list->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(denoised, D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS));
 
         // FINALIZE
 
@@ -93,6 +93,44 @@ typedef UINT16 Index;
 
 // shared typedefs
 
+#define BLUE_NOISE_MASK_SIZE 64
+
+#define RADIANCE_CACHE_CAPACITY (1 << 18) // hash grid entries
+
+#define TRANSLUCENT_OCTREE_MAX_DEPTH   12 // levels, including the root
+#define TRANSLUCENT_OCTREE_LEAF_POINTS 8
+#define TRANSLUCENT_OCTREE_STACK_SIZE  (7*(TRANSLUCENT_OCTREE_MAX_DEPTH - 1) + 1)
+#define TRANSLUCENT_GRID_CELL_SPACINGS 4 // cell size in mean sample point spacings
+#define TRANSLUCENT_GRID_MAX_CELLS     8 // per sample point, growing the cells of sparse instances
+#define TRANSLUCENT_POSITION_BITS      21 // per axis of compact positions, packed into 64 bits
+#define RGB9E5_MAX                     (511.0/512.0 * 65536.0) // largest channel of compact payloads
+
+#define TRANSLUCENT_DIPOLE_LUT_SIZE      1024
+#define TRANSLUCENT_DIPOLE_LUT_TOLERANCE 1e-6f // of the profile's peak, below which the table ends
+
+#define GUIDING_RECORDS_CAPACITY (1 << 18) // radiance records per training iteration
+#define GUIDING_MAX_DEPTH        12        // of the directional quadtrees
+#define GUIDING_LEAF             0xffffffff
+
+// AOV_* flag the first hit outputs written by the integrator
+#define AOV_NORMAL_DEPTH 0x1 // g_first_hits, also written for reprojection
+#define AOV_ALBEDO       0x2 // g_first_hit_albedo
+#define AOV_IDS          0x4 // g_first_hit_ids
+
+// FRAME_STATISTICS_* index the per-frame statistics counters
+#define FRAME_STATISTICS_RAY_COUNT      0 // rays traced
+#define FRAME_STATISTICS_PIXEL_VARIANCE 1 // summed variance of the pixels' samples, 64-bit fixed point, low word first
+#define FRAME_STATISTICS_COUNT          3
+#define FRAME_STATISTICS_FIXED_POINT    1024.0
+
+enum Shader {
+    Lambert = 0,
+    Light,
+    Translucent,
+
+    Count,
+};
+
 COMMON_DECL struct Vertex {
     COMMON_FLOAT3 position;
     COMMON_FLOAT3 normal;
@@ -136,6 +174,63 @@ COMMON_DECL struct RaytracingGlobals {
     COMMON_UINT     _pad140;
 
     COMMON_FLOAT3   light_color;
+
+    // explicit light sampling
+    COMMON_UINT     emitters_count;
+    COMMON_FLOAT    emitters_total_area;
+    COMMON_UINT     light_sampling;
+
+    // path termination
+    COMMON_UINT     roulette_min_bounces;
+    COMMON_FLOAT    split_threshold; // 0 to disable splitting
+
+    // sampling
+    COMMON_UINT     low_discrepancy_sampling;
+    COMMON_UINT     sampler_seed; // fixed while samples accumulate
+
+    // radiance cache
+    COMMON_UINT     radiance_cache_depth;       // bounce at which paths terminate into the cache, 0 to disable
+    COMMON_FLOAT    radiance_cache_cell_size;
+    COMMON_UINT     radiance_cache_min_samples; // entries with fewer samples are not used
+
+    // path guiding
+    COMMON_FLOAT3   guiding_aabb_min;           // bounds of the spatial tree
+    COMMON_FLOAT3   guiding_aabb_max;
+    COMMON_FLOAT    guiding_record_probability; // of recording a path for training, 0 when not training
+    COMMON_UINT     guiding_sampling;           // 0 until a distribution has been trained
+
+    // temporal reprojection
+    COMMON_UINT     reprojection;                 // pixels keep their own sample counts, 0 to share accumulator_count
+    COMMON_UINT     reprojection_max_samples;     // warped history is clamped to this many samples
+    COMMON_UINT     reproject_history;            // the camera moved since the previous frame
+    COMMON_FLOAT4X4 previous_world_to_camera;
+    COMMON_FLOAT    previous_camera_focal_length;
+
+    // dynamic resolution and coarse-to-fine refinement
+    COMMON_UINT     render_scale;  // size of the pixel blocks of which one pixel is traced, 1 for full resolution
+    COMMON_UINT     render_offset; // of the traced pixel in its block, along both axes
+
+    // light-linear accumulation
+    COMMON_UINT     _pad316;
+    COMMON_FLOAT3   light_scale; // of the accumulated radiance at display, the light color when rendering for unit light
+
+    // first hit outputs
+    COMMON_UINT     aovs; // AOV_* written this frame
+
+    // hierarchical subsurface integration
+    COMMON_FLOAT    translucent_octree_error;  // largest solid angle of clusters evaluated as one point, 0 to evaluate every point
+    COMMON_FLOAT    translucent_cutoff_radius; // beyond which the bssrdf is neglected, 0 for no cutoff
+    COMMON_FLOAT    translucent_dipole_lut_radius; // covered by the dipole profile table, 0 to evaluate the dipole
+    COMMON_UINT     translucent_compact_samples;   // the grid's sample points are quantized, as generated
+
+    // budgeted sample collection
+    COMMON_UINT     translucent_update_offset; // of the window of each instance's points updated by translucent_rgen
+
+    // bssrdf probe rays
+    COMMON_UINT     translucent_probes;       // per translucent hit, 0 to gather the sample points instead, scattering only direct light
+    COMMON_FLOAT    translucent_probe_radius; // of the sampled disks, the cutoff radius or else where the profile vanishes
+
+    COMMON_UINT     translucent_sampler_seed; // fixed while translucent samples accumulate
 };
 
 COMMON_DECL struct RaytracingLocals {
@@ -143,8 +238,114 @@ COMMON_DECL struct RaytracingLocals {
     COMMON_INT    translucent_id;
 };
 
+// world-space triangle of Shader::Light geometry, for area-weighted light sampling
+COMMON_DECL struct EmitterTriangle {
+    COMMON_FLOAT3 position; // first vertex
+    COMMON_FLOAT3 edge1;
+    COMMON_FLOAT3 edge2;
+    COMMON_FLOAT3 normal;   // emitting side, matches back-face culling of the triangle
+    COMMON_FLOAT3 color;    // zero to use the global light color
+    COMMON_FLOAT  cdf;      // summed area of the emitter table up to and including this triangle
+};
+
+// wavefront integrator queues of path ids: a bin per shader and one for misses, filled by the trace dispatch and emptied
+// by the shade dispatches, followed by the trace queue, filled by the generate and shade dispatches
+#define PATH_MISS_QUEUE   Shader::Count
+#define PATH_TRACE_QUEUE  (Shader::Count + 1)
+#define PATH_QUEUES_COUNT (Shader::Count + 2)
+
+// root constants for the wavefront integrator kernels
+COMMON_DECL struct WavefrontConstants {
+    COMMON_UINT sample_index;
+    COMMON_UINT bounce_index;
+    COMMON_UINT paths_count;
+    COMMON_UINT shader; // bin of the shade dispatch
+};
+
+// surface of the hit found by the wavefront trace dispatch, resolved by the hit shader for the shade dispatch of its bin
+COMMON_DECL struct PathHit {
+    COMMON_FLOAT3 normal;            // shading normal, facing the ray
+    COMMON_FLOAT3 object_position;   // in the object space of the mesh
+    COMMON_FLOAT3 color;             // of the instance's material
+    COMMON_UINT   translucent_index; // of the instance's translucent properties and sample points
+    COMMON_UINT2  ids;               // instance index, primitive index
+};
+
+// first hit of a camera path, recorded by the integrators for the first hit outputs and reprojection
+COMMON_DECL struct FirstHit {
+    COMMON_FLOAT  t;      // INFINITY on a miss
+    COMMON_FLOAT3 normal; // shading normal, facing the camera
+    COMMON_FLOAT3 albedo;
+    COMMON_UINT2  ids;    // instance index, primitive index; ~0 on a miss, or if AOV_IDS is not written
+};
+
+// root constants for the tiles of a cancellable frame, which dispatch bands of rows
+COMMON_DECL struct TileConstants {
+    COMMON_UINT first_row;
+};
+
+// root constants for the refit of the translucent octrees, which dispatches their levels bottom-up
+COMMON_DECL struct TranslucentRefitConstants {
+    COMMON_UINT level;
+};
+
+// path guiding: binary spatial tree over guiding_aabb_*, halving the node along `axis` at each level
+COMMON_DECL struct GuidingSpatialNode {
+    COMMON_UINT axis;  // GUIDING_LEAF for leaves
+    COMMON_UINT child; // first of the two children, or the directional tree root of a leaf
+};
+
+// directional quadtree over the square of cylindrical coordinates (cos theta, phi), which maps uniformly to the sphere
+// quadrant i covers x in [i%2, i%2+1]/2, y in [i/2, i/2+1]/2 of the node
+COMMON_DECL struct GuidingDirectionalNode {
+    COMMON_FLOAT4 energy; // per quadrant; all zero for a uniform node
+    COMMON_UINT4  child;  // per quadrant, 0 if the quadrant is not subdivided
+};
+
+// incident radiance sample from a path vertex
+COMMON_DECL struct GuidingRecord {
+    COMMON_FLOAT3 position;
+    COMMON_FLOAT  radiance;  // luminance
+    COMMON_FLOAT3 direction;
+    COMMON_FLOAT  pdf;       // of sampling `direction`
+};
+
+// octree over the sample points of a translucent instance, for hierarchical integration
+// nodes are stored breadth-first so that each level is contiguous, with the children of a node consecutive
+COMMON_DECL struct TranslucentNode {
+    COMMON_FLOAT3 centroid; // mean position of the node's points
+    COMMON_FLOAT  radius;   // of the bounding sphere of the node's points around the centroid
+    COMMON_FLOAT  area;     // summed area of the node's points
+    COMMON_UINT   leaf;
+    COMMON_UINT   first;    // first child, or first point in the instance's point indices for leaves
+    COMMON_UINT   count;    // of children, or of points for leaves
+};
+
+// sample points, octrees and grids are in the object space of their mesh, shared by its instances
 COMMON_DECL struct TranslucentProperties {
-    COMMON_FLOAT samples_mean_area;
+    COMMON_FLOAT  samples_mean_area; // in world space, of the instance
+
+    // of the instance, with uniform scale
+    COMMON_FLOAT3 object_to_world[4]; // rows of the affine transform, the last is the translation
+    COMMON_FLOAT  scale;
+
+    // per instance, in the node flux and grid payload arrays of all instances
+    COMMON_UINT   node_flux_offset;
+    COMMON_UINT   grid_payloads_offset;
+
+    // octree, in the node and point index arrays of all meshes
+    COMMON_UINT  nodes_offset;
+    COMMON_UINT  point_indices_offset;
+    COMMON_UINT  octree_levels_count; // 0 without an octree
+    COMMON_UINT  octree_level_offsets[TRANSLUCENT_OCTREE_MAX_DEPTH + 1]; // relative to nodes_offset, the last is the nodes count
+
+    // uniform grid, in the cell and point index arrays of all meshes
+    // the points of cell i are grid_point_indices[grid_cells[i]..grid_cells[i + 1]]
+    COMMON_FLOAT3 grid_origin;
+    COMMON_FLOAT  grid_cell_size; // 0 without a grid
+    COMMON_UINT3  grid_dimensions;
+    COMMON_UINT   grid_cells_offset;
+    COMMON_UINT   grid_point_indices_offset;
 };
 
 // HELPER FUNCTIONS
@@ -192,6 +393,8 @@ inline float length2(float4 x) { return dot(x, x); };
 inline float length2(float3 x) { return dot(x, x); };
 inline float length2(float2 x) { return dot(x, x); };
 
+inline float luminance(float3 rgb) { return dot(rgb, float3(0.2126, 0.7152, 0.0722)); };
+
 inline uint3 load_3x16bit_indices(uniform ByteAddressBuffer index_buffer, uint primitive_index) {
     const uint indices_per_primitive = 3;
     const uint bytes_per_index       = 2;
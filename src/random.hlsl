@@ -87,7 +87,151 @@ float3 random_on_hemisphere(inout uint seed, float3 normal) {
     return unit - min(0.0, 2.0*dot(normal, unit))*normal;
 }
 
+// cosine-weighted direction: offsetting a uniform point on the unit sphere by the normal gives pdf = cos(theta)/pi
+float3 random_cosine_on_hemisphere(inout uint seed, float3 normal) {
+    float3 direction = normal + random_on_sphere(seed);
+    float  length2   = dot(direction, direction);
+    if (length2 < 0.000001) return normal; // degenerate: sphere sample opposite the normal
+    return direction * rsqrt(length2);
+}
+
 float3 random_inside_hemisphere(inout uint seed, float3 normal) {
     float3 unit = random_inside_sphere(seed);
     return unit - min(0.0, 2.0*dot(normal, unit))*normal;
 }
+
+// LOW-DISCREPANCY SAMPLER
+
+// owen-scrambled sobol sequence using hash-based nested uniform scrambling
+// Burley 2020, "Practical Hash-based Owen Scrambling"
+// dimensions are padded from independently shuffled 4D sobol sequences, so any number of dimensions can be drawn
+
+static const uint SOBOL_DIRECTIONS[4][32] = {
+    {
+        0x80000000u, 0x40000000u, 0x20000000u, 0x10000000u, 0x08000000u, 0x04000000u, 0x02000000u, 0x01000000u,
+        0x00800000u, 0x00400000u, 0x00200000u, 0x00100000u, 0x00080000u, 0x00040000u, 0x00020000u, 0x00010000u,
+        0x00008000u, 0x00004000u, 0x00002000u, 0x00001000u, 0x00000800u, 0x00000400u, 0x00000200u, 0x00000100u,
+        0x00000080u, 0x00000040u, 0x00000020u, 0x00000010u, 0x00000008u, 0x00000004u, 0x00000002u, 0x00000001u,
+    },
+    {
+        0x80000000u, 0xc0000000u, 0xa0000000u, 0xf0000000u, 0x88000000u, 0xcc000000u, 0xaa000000u, 0xff000000u,
+        0x80800000u, 0xc0c00000u, 0xa0a00000u, 0xf0f00000u, 0x88880000u, 0xcccc0000u, 0xaaaa0000u, 0xffff0000u,
+        0x80008000u, 0xc000c000u, 0xa000a000u, 0xf000f000u, 0x88008800u, 0xcc00cc00u, 0xaa00aa00u, 0xff00ff00u,
+        0x80808080u, 0xc0c0c0c0u, 0xa0a0a0a0u, 0xf0f0f0f0u, 0x88888888u, 0xccccccccu, 0xaaaaaaaau, 0xffffffffu,
+    },
+    {
+        0x80000000u, 0xc0000000u, 0x60000000u, 0x90000000u, 0xe8000000u, 0x5c000000u, 0x8e000000u, 0xc5000000u,
+        0x68800000u, 0x9cc00000u, 0xee600000u, 0x55900000u, 0x80680000u, 0xc09c0000u, 0x60ee0000u, 0x90550000u,
+        0xe8808000u, 0x5cc0c000u, 0x8e606000u, 0xc5909000u, 0x6868e800u, 0x9c9c5c00u, 0xeeee8e00u, 0x5555c500u,
+        0x8000e880u, 0xc0005cc0u, 0x60008e60u, 0x9000c590u, 0xe8006868u, 0x5c009c9cu, 0x8e00eeeeu, 0xc5005555u,
+    },
+    {
+        0x80000000u, 0xc0000000u, 0x20000000u, 0x50000000u, 0xf8000000u, 0x74000000u, 0xa2000000u, 0x93000000u,
+        0xd8800000u, 0x25400000u, 0x59e00000u, 0xe6d00000u, 0x78080000u, 0xb40c0000u, 0x82020000u, 0xc3050000u,
+        0x208f8000u, 0x51474000u, 0xfbea2000u, 0x75d93000u, 0xa0858800u, 0x914e5400u, 0xdbe79e00u, 0x25db6d00u,
+        0x58800080u, 0xe54000c0u, 0x79e00020u, 0xb6d00050u, 0x800800f8u, 0xc00c0074u, 0x200200a2u, 0x50050093u,
+    },
+};
+
+uint sobol(uint index, uint dimension) {
+    uint result = 0;
+    for (uint bit = 0; index != 0; bit++, index >>= 1) {
+        if (index & 1) result ^= SOBOL_DIRECTIONS[dimension][bit];
+    }
+    return result;
+}
+
+uint laine_karras_permutation(uint x, uint seed) {
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return x;
+}
+
+uint nested_uniform_scramble(uint x, uint seed) {
+    x = reversebits(x);
+    x = laine_karras_permutation(x, seed);
+    x = reversebits(x);
+    return x;
+}
+
+// float in the range [0.0f, 1.0f)
+float sobol_owen(uint index, uint dimension, uint seed) {
+    index = nested_uniform_scramble(index, hash(uint2(seed, dimension / 4))); // shuffle the points of each 4D pad
+    uint x = nested_uniform_scramble(sobol(index, dimension % 4), hash(uint2(dimension, seed)));
+    return asfloat(0x3f800000 | (x >> 9)) - 1;
+}
+
+#define SAMPLER_UNIFORM_RANDOM 0xffffffff // sample index of samplers which fall back to the xorshift generator
+#define GOLDEN_RATIO_CONJUGATE 0.61803398875
+
+// stateful rng over the dimensions of one sample
+// low-discrepancy samples are toroidally shifted (Cranley-Patterson rotation) by a per-pixel offset,
+// which decorrelates neighbouring pixels when the offsets come from a blue-noise mask
+struct Sampler {
+    uint  seed;      // scramble seed, or xorshift state for uniform random samplers
+    uint  index;     // sample index in the sequence
+    uint  dimension; // next dimension to draw
+    float rotation;
+};
+
+Sampler sampler_init_random(uint seed) {
+    Sampler rng;
+    rng.seed      = seed;
+    rng.index     = SAMPLER_UNIFORM_RANDOM;
+    rng.dimension = 0;
+    rng.rotation  = 0;
+    return rng;
+}
+
+Sampler sampler_init_sobol(uint seed, uint index, float rotation) {
+    Sampler rng;
+    rng.seed      = seed;
+    rng.index     = index;
+    rng.dimension = 0;
+    rng.rotation  = rotation;
+    return rng;
+}
+
+// sample float in the range [0.0f, 1.0f)
+float random01(inout Sampler rng) {
+    if (rng.index == SAMPLER_UNIFORM_RANDOM) return random01(rng.seed);
+
+    float x = sobol_owen(rng.index, rng.dimension, rng.seed);
+    x = frac(x + rng.rotation + rng.dimension*GOLDEN_RATIO_CONJUGATE); // vary the rotation between dimensions
+    rng.dimension += 1;
+    return x;
+}
+
+// sample float in the range [-1.0f, 1.0f)
+float random11(inout Sampler rng) {
+    return 2*random01(rng) - 1;
+}
+
+float3 random_on_sphere(inout Sampler rng) {
+    float phi       = random01(rng)*TAU;
+    float cos_theta = random11(rng);
+    float sin_theta = sqrt(1 - cos_theta*cos_theta);
+    return float3(sin_theta*cos(phi), sin_theta*sin(phi), cos_theta);
+}
+
+// cosine-weighted hemisphere direction from two uniform numbers, placing a unit sphere on the normal
+float3 cosine_on_hemisphere(float2 u, float3 normal) {
+    float phi       = u.x*TAU;
+    float cos_theta = 2*u.y - 1;
+    float sin_theta = sqrt(1 - cos_theta*cos_theta);
+
+    float3 direction = normal + float3(sin_theta*cos(phi), sin_theta*sin(phi), cos_theta);
+    float  length2   = dot(direction, direction);
+    if (length2 < 0.000001) return normal;
+    return direction * rsqrt(length2);
+}
+
+float3 random_cosine_on_hemisphere(inout Sampler rng, float3 normal) {
+    float2 u;
+    u.x = random01(rng);
+    u.y = random01(rng);
+    return cosine_on_hemisphere(u, normal);
+}
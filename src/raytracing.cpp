@@ -1,6 +1,8 @@
 #include "raytracing.h"
 
 #include "bluenoise.h"
+#include "guiding.h"
+#include "translucent.h"
 
 using Device::g_device;
 
@@ -13,13 +15,33 @@ ID3D12StateObjectProperties* g_properties = NULL;
 
 ID3D12RootSignature* g_global_root_signature = NULL;
 
-ShaderIdentifier g_camera_rgen         = {};
-ShaderIdentifier g_translucent_rgen    = {};
-ShaderIdentifier g_miss                = {};
-ShaderIdentifier g_chit[Shader::Count] = {};
-
-ID3D12Resource* g_camera_rgen_shader_record      = NULL;
-ID3D12Resource* g_translucent_rgen_shader_record = NULL;
+ShaderIdentifier g_camera_rgen             = {};
+ShaderIdentifier g_translucent_rgen        = {};
+ShaderIdentifier g_wavefront_generate_rgen = {};
+ShaderIdentifier g_wavefront_trace_rgen    = {};
+ShaderIdentifier g_wavefront_shade_rgen    = {};
+ShaderIdentifier g_wavefront_resolve_rgen  = {};
+ShaderIdentifier g_bdpt_rgen               = {};
+ShaderIdentifier g_radiance_cache_clear_rgen = {};
+ShaderIdentifier g_translucent_refit_rgen   = {};
+ShaderIdentifier g_translucent_permute_rgen = {};
+ShaderIdentifier g_translucent_photon_rgen  = {};
+ShaderIdentifier g_translucent_photon_resolve_rgen = {};
+ShaderIdentifier g_miss                    = {};
+ShaderIdentifier g_chit[Shader::Count]     = {};
+
+ID3D12Resource* g_camera_rgen_shader_record             = NULL;
+ID3D12Resource* g_translucent_rgen_shader_record        = NULL;
+ID3D12Resource* g_wavefront_generate_rgen_shader_record = NULL;
+ID3D12Resource* g_wavefront_trace_rgen_shader_record    = NULL;
+ID3D12Resource* g_wavefront_shade_rgen_shader_record    = NULL;
+ID3D12Resource* g_wavefront_resolve_rgen_shader_record  = NULL;
+ID3D12Resource* g_bdpt_rgen_shader_record               = NULL;
+ID3D12Resource* g_radiance_cache_clear_rgen_shader_record = NULL;
+ID3D12Resource* g_translucent_refit_rgen_shader_record   = NULL;
+ID3D12Resource* g_translucent_permute_rgen_shader_record = NULL;
+ID3D12Resource* g_translucent_photon_rgen_shader_record  = NULL;
+ID3D12Resource* g_translucent_photon_resolve_rgen_shader_record = NULL;
 ID3D12Resource* g_hit_group_shader_table = NULL;
 ID3D12Resource* g_miss_shader_table      = NULL;
 
@@ -28,11 +50,115 @@ ID3D12Resource*   g_globals_buffer = NULL;
 ID3D12Resource*   g_globals_upload = NULL;
 
 UINT            g_width, g_height    = 0;
+UINT            g_render_width       = 0; // traced this frame, reduced by g_globals.render_scale
+UINT            g_render_height      = 0;
 ID3D12Resource* g_render_target      = NULL;
 ID3D12Resource* g_sample_accumulator = NULL;
+ID3D12Resource* g_sample_counts      = NULL; // per pixel, since coarse frames and reprojection sample pixels unevenly
 
 ID3D12Resource* g_scene = NULL;
 
+// dynamic resolution, previewing camera motion at a reduced resolution within a frame time budget
+#define RENDER_SCALE_MAX 16
+
+bool  g_enable_dynamic_resolution       = false;
+bool  g_interacting                     = false; // set while the camera moves
+float g_interaction_budget_milliseconds = 16;
+
+// cancellable frames, whose render dispatch is split into bands of rows submitted one at a time
+UINT g_frame_tiles            = 4; // 1 to render frames in one dispatch
+UINT g_cancelled_frames_count = 0;
+
+// coarse-to-fine refinement: the first frames of an image trace one pixel per block, a different one at each level,
+// and their samples stay in the accumulator
+struct RefinementLevel {
+    UINT scale;
+    UINT offset;
+};
+RefinementLevel g_refinement_levels[] = { { 4, 0 }, { 2, 1 } }; // 1/16, then 1/4 of the pixels
+bool            g_enable_progressive_refinement = true;
+
+bool g_enable_bidirectional = false;
+
+// wavefront integrator path state, allocated only while enabled
+#define WAVEFRONT_CONSTANTS_ROOT_INDEX 5
+#define TILE_CONSTANTS_ROOT_INDEX      17
+
+bool            g_enable_wavefront        = false;
+ID3D12Resource* g_path_origins            = NULL;
+ID3D12Resource* g_path_directions         = NULL;
+ID3D12Resource* g_path_throughputs        = NULL;
+ID3D12Resource* g_path_radiances          = NULL;
+ID3D12Resource* g_path_rngs               = NULL;
+ID3D12Resource* g_path_queues             = NULL;
+ID3D12Resource* g_path_queue_counts       = NULL;
+ID3D12Resource* g_path_queue_counts_reset = NULL; // zeroed source for clearing a queue's counts, and other counters
+ID3D12Resource* g_path_first_hits         = NULL; // FirstHit per pixel, of its first sample
+ID3D12Resource* g_path_hits               = NULL; // PathHit per path, from the trace dispatch to the shade dispatches
+
+// trace and shade dispatches, sized by the path queue counts on the gpu
+ID3D12CommandSignature* g_dispatch_rays_signature = NULL;
+ID3D12Resource*         g_path_dispatches         = NULL; // D3D12_DISPATCH_RAYS_DESC per queue
+ID3D12Resource*         g_path_dispatches_upload  = NULL;
+
+// light sampling
+Array<EmitterTriangle> g_blas_emitters  = {}; // object space, cdf unused
+ID3D12Resource*        g_emitters_buffer = NULL;
+bool                   g_fixed_color_emitters = false; // instantiated in the scene, whose radiance is then not linear in g_globals.light_color
+
+// sampling
+ID3D12Resource* g_blue_noise_mask = NULL;
+
+// radiance cache
+ID3D12Resource* g_radiance_cache_keys   = NULL;
+ID3D12Resource* g_radiance_cache_values = NULL;
+bool            g_clear_radiance_cache  = true; // buffers are created uninitialized
+
+// gpu frame timing
+ID3D12QueryHeap* g_timestamp_query_heap = NULL;
+ID3D12Resource*  g_timestamp_readback   = NULL;
+double           g_render_milliseconds  = 0;
+
+// frame statistics
+ID3D12Resource* g_frame_statistics          = NULL;
+ID3D12Resource* g_frame_statistics_readback = NULL;
+double          g_rays_per_sample           = 0;
+double          g_pixel_variance            = 0; // 0 if not measured
+
+// path guiding, trained over GUIDING_TRAINING_ITERATIONS iterations, after which the distribution is fixed
+// iteration i records the paths of 2^i frames, as in Müller et al. 2017
+#define GUIDING_TRAINING_ITERATIONS           8
+#define GUIDING_SPATIAL_NODES_ROOT_INDEX      12
+#define GUIDING_DIRECTIONAL_NODES_ROOT_INDEX  13
+
+bool                    g_enable_guiding                    = false;
+bool                    g_reset_guiding                     = true;
+GuidingTree             g_guiding_tree                      = {};
+Array<GuidingIteration> g_guiding_report                    = {};
+UINT                    g_guiding_frames                    = 0; // recorded in the current iteration
+double                  g_guiding_variance_sum              = 0; // of the current iteration's frames
+ID3D12Resource*         g_guiding_spatial_nodes_buffer      = NULL;
+ID3D12Resource*         g_guiding_directional_nodes_buffer  = NULL;
+ID3D12Resource*         g_guiding_records                   = NULL;
+ID3D12Resource*         g_guiding_records_count             = NULL;
+ID3D12Resource*         g_guiding_records_readback          = NULL;
+ID3D12Resource*         g_guiding_records_count_readback    = NULL;
+
+// temporal reprojection, per-pixel state allocated only while enabled
+bool            g_enable_reprojection          = false;
+bool            g_reproject_accumulator        = false; // the camera moved since the previous frame
+XMFLOAT4X4A     g_previous_camera_to_world     = {};
+float           g_previous_camera_focal_length = 0;
+ID3D12Resource* g_first_hits                   = NULL;
+ID3D12Resource* g_history_accumulator          = NULL;
+ID3D12Resource* g_history_first_hits           = NULL;
+ID3D12Resource* g_history_counts               = NULL;
+
+// first hit AOVs, allocated only while requested, sharing g_first_hits with reprojection
+UINT            g_aovs                         = 0; // AOV_*
+ID3D12Resource* g_first_hit_albedo             = NULL;
+ID3D12Resource* g_first_hit_ids                = NULL;
+
 UINT g_bssrdf_tabulations = 0;
 ID3D12Resource* g_bssrdf = NULL;
 
@@ -50,6 +176,18 @@ struct TranslucentMesh {
     BluenoisePreprocess preprocess;
     ID3D12Resource* ib; UINT ib_offset;
     ID3D12Resource* vb;
+
+    // sample points in object space, shared by the mesh's instances
+    float             radius; // rejection radius in object space, of the last generation
+    bool              compact;
+    bool              morton_ordered;
+    ID3D12Resource*   positions_buffer;
+    ID3D12Resource*   point_normals_buffer;
+    TranslucentOctree octree;
+    TranslucentGrid   grid;
+    Array<UINT>       grid_positions; // float3, or encoded if compact
+    float             position_error; // largest distance of a decoded position, if compact
+    UINT              samples_count;
 };
 struct TranslucentInstance {
     UINT       translucent_id;
@@ -58,9 +196,9 @@ struct TranslucentInstance {
     XMFLOAT4X4 transform;
     float      scale_factor;
 
-    ID3D12Resource* sample_points_buffer;
-    ID3D12Resource* write_sample_points_buffer;
-    ID3D12Resource* point_normals_buffer;
+    // irradiance at the mesh's sample points, with the count of updates of each
+    ID3D12Resource* payloads_buffer;
+    ID3D12Resource* write_payloads_buffer;
     UINT            samples_count;
 };
 Array<TranslucentMesh>     g_translucent_meshes    = {};
@@ -69,6 +207,46 @@ UINT                       g_max_translucent_samples_count = 0;
 
 bool g_enable_translucent_sample_collection = true;
 bool g_enable_subsurface_scattering         = true;
+bool g_morton_order_sample_points           = true;
+
+// paths traced by translucent_rgen per frame, which updates a window of each instance's points rotating over frames
+UINT g_translucent_ray_budget    = 0; // 0 to update every point every frame
+UINT g_translucent_update_window = 0; // points of each instance updated by the last frame
+
+// photons shot from the emitters per frame instead, whose cost is independent of the sample points count
+bool g_enable_translucent_photons = false;
+UINT g_translucent_photons_count  = 1 << 18;
+
+// octrees over the sample points of all translucent meshes, concatenated, with the flux of all instances
+#define TRANSLUCENT_REFIT_ROOT_INDEX 21
+
+ID3D12Resource* g_translucent_nodes_buffer         = NULL;
+ID3D12Resource* g_translucent_point_indices_buffer = NULL;
+ID3D12Resource* g_translucent_node_flux_buffer     = NULL; // summed payload of each node's points, refit after sample collection
+UINT            g_translucent_level_widths[TRANSLUCENT_OCTREE_MAX_DEPTH] = {}; // most nodes in a level of any mesh
+UINT            g_translucent_levels_count = 0;
+bool            g_translucent_refit_pending = false; // the flux is uninitialized after regenerating the sample points
+
+// uniform grids over the sample points of all translucent meshes, concatenated, with the payloads of all instances
+ID3D12Resource* g_translucent_grid_cells_buffer         = NULL;
+ID3D12Resource* g_translucent_grid_point_indices_buffer = NULL;
+ID3D12Resource* g_translucent_grid_positions_buffer     = NULL; // SoA copies of the sample points in grid order, per mesh
+ID3D12Resource* g_translucent_grid_payloads_buffer      = NULL; // permuted after sample collection, per instance
+ID3D12Resource* g_translucent_photon_flux_buffer        = NULL; // deposited by photons, in grid order per instance
+bool            g_compact_sample_points                 = false;
+float           g_compact_position_error                = 0; // largest distance of a decoded position in object space
+float           g_compact_payload_error                 = 0; // of an RGB9E5 round trip, relative to the largest channel
+float           g_translucent_cutoff_tolerance          = 1e-4f;
+
+// dipole profile table, rebuilt when the parameters of the dipole change
+bool            g_enable_dipole_lut            = true;
+float           g_dipole_lut_error             = 0; // of linear interpolation, relative to the profile's peak
+ID3D12Resource* g_dipole_lut                   = NULL;
+ID3D12Resource* g_dipole_lut_upload            = NULL;
+XMFLOAT3        g_dipole_lut_scattering        = {};
+XMFLOAT3        g_dipole_lut_absorption        = {};
+float           g_dipole_lut_refractive_index  = 0;
+float           g_dipole_lut_radius            = 0; // 0 while the profile vanishes
 
 void init(ID3D12GraphicsCommandList* cmd_list) {
     { // g_pso, g_properties
@@ -90,6 +268,36 @@ void init(ID3D12GraphicsCommandList* cmd_list) {
         void* translucent_rgen = g_properties->GetShaderIdentifier(L"translucent_rgen");
         memcpy(&g_translucent_rgen, translucent_rgen, D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES);
 
+        void* wavefront_generate_rgen = g_properties->GetShaderIdentifier(L"wavefront_generate_rgen");
+        memcpy(&g_wavefront_generate_rgen, wavefront_generate_rgen, D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES);
+
+        void* wavefront_trace_rgen = g_properties->GetShaderIdentifier(L"wavefront_trace_rgen");
+        memcpy(&g_wavefront_trace_rgen, wavefront_trace_rgen, D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES);
+
+        void* wavefront_shade_rgen = g_properties->GetShaderIdentifier(L"wavefront_shade_rgen");
+        memcpy(&g_wavefront_shade_rgen, wavefront_shade_rgen, D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES);
+
+        void* wavefront_resolve_rgen = g_properties->GetShaderIdentifier(L"wavefront_resolve_rgen");
+        memcpy(&g_wavefront_resolve_rgen, wavefront_resolve_rgen, D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES);
+
+        void* bdpt_rgen = g_properties->GetShaderIdentifier(L"bdpt_rgen");
+        memcpy(&g_bdpt_rgen, bdpt_rgen, D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES);
+
+        void* radiance_cache_clear_rgen = g_properties->GetShaderIdentifier(L"radiance_cache_clear_rgen");
+        memcpy(&g_radiance_cache_clear_rgen, radiance_cache_clear_rgen, D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES);
+
+        void* translucent_refit_rgen = g_properties->GetShaderIdentifier(L"translucent_refit_rgen");
+        memcpy(&g_translucent_refit_rgen, translucent_refit_rgen, D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES);
+
+        void* translucent_permute_rgen = g_properties->GetShaderIdentifier(L"translucent_permute_rgen");
+        memcpy(&g_translucent_permute_rgen, translucent_permute_rgen, D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES);
+
+        void* translucent_photon_rgen = g_properties->GetShaderIdentifier(L"translucent_photon_rgen");
+        memcpy(&g_translucent_photon_rgen, translucent_photon_rgen, D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES);
+
+        void* translucent_photon_resolve_rgen = g_properties->GetShaderIdentifier(L"translucent_photon_resolve_rgen");
+        memcpy(&g_translucent_photon_resolve_rgen, translucent_photon_resolve_rgen, D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES);
+
         void* miss = g_properties->GetShaderIdentifier(L"miss");
         memcpy(&g_miss, miss, D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES);
 
@@ -102,12 +310,34 @@ void init(ID3D12GraphicsCommandList* cmd_list) {
         }
     };
 
+    { // ray generation shader records and miss shader table, which don't depend on the scene
+        g_camera_rgen_shader_record      = create_buffer_and_write_contents(cmd_list, array_of(&Raytracing::g_camera_rgen),      D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, NULL);
+        g_translucent_rgen_shader_record = create_buffer_and_write_contents(cmd_list, array_of(&Raytracing::g_translucent_rgen), D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, NULL);
+        g_miss_shader_table              = create_buffer_and_write_contents(cmd_list, array_of(&Raytracing::g_miss),             D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, NULL);
+        g_wavefront_generate_rgen_shader_record = create_buffer_and_write_contents(cmd_list, array_of(&Raytracing::g_wavefront_generate_rgen), D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, NULL);
+        g_wavefront_trace_rgen_shader_record    = create_buffer_and_write_contents(cmd_list, array_of(&Raytracing::g_wavefront_trace_rgen),    D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, NULL);
+        g_wavefront_shade_rgen_shader_record    = create_buffer_and_write_contents(cmd_list, array_of(&Raytracing::g_wavefront_shade_rgen),    D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, NULL);
+        g_wavefront_resolve_rgen_shader_record  = create_buffer_and_write_contents(cmd_list, array_of(&Raytracing::g_wavefront_resolve_rgen),  D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, NULL);
+        g_bdpt_rgen_shader_record               = create_buffer_and_write_contents(cmd_list, array_of(&Raytracing::g_bdpt_rgen),               D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, NULL);
+        g_radiance_cache_clear_rgen_shader_record = create_buffer_and_write_contents(cmd_list, array_of(&Raytracing::g_radiance_cache_clear_rgen), D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, NULL);
+        g_translucent_refit_rgen_shader_record    = create_buffer_and_write_contents(cmd_list, array_of(&Raytracing::g_translucent_refit_rgen),    D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, NULL);
+        g_translucent_permute_rgen_shader_record  = create_buffer_and_write_contents(cmd_list, array_of(&Raytracing::g_translucent_permute_rgen),  D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, NULL);
+        g_translucent_photon_rgen_shader_record   = create_buffer_and_write_contents(cmd_list, array_of(&Raytracing::g_translucent_photon_rgen),   D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, NULL);
+        g_translucent_photon_resolve_rgen_shader_record = create_buffer_and_write_contents(cmd_list, array_of(&Raytracing::g_translucent_photon_resolve_rgen), D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, NULL);
+    }
+
     // g_global_root_signature
     CHECK_RESULT(g_device->CreateRootSignature(0, g_raytracing_hlsl_bytecode, _countof(g_raytracing_hlsl_bytecode), IID_PPV_ARGS(&g_global_root_signature)));
 
     g_globals_buffer = create_buffer(sizeof(RaytracingGlobals), D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_HEAP_TYPE_DEFAULT);
     g_globals_upload = create_buffer(sizeof(RaytracingGlobals), D3D12_RESOURCE_STATE_GENERIC_READ,                                                                D3D12_HEAP_TYPE_UPLOAD);
 
+    { // g_dipole_lut, written by update_dipole_lut
+        g_dipole_lut        = create_buffer(TRANSLUCENT_DIPOLE_LUT_SIZE*sizeof(XMFLOAT3), D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+        g_dipole_lut_upload = create_buffer(TRANSLUCENT_DIPOLE_LUT_SIZE*sizeof(XMFLOAT3), D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_HEAP_TYPE_UPLOAD);
+        SET_NAME(g_dipole_lut);
+    }
+
     { // g_bssrdf
         #include "data/skin_0.h"
         g_bssrdf_tabulations = round_up(data_len, D3D12_TEXTURE_DATA_PITCH_ALIGNMENT);
@@ -138,11 +368,103 @@ void init(ID3D12GraphicsCommandList* cmd_list) {
         g_bssrdf = create_texture_and_write_contents(cmd_list, D3D12_RESOURCE_DIMENSION_TEXTURE1D, &bssrdf_footprint, bssrdf, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, NULL);
         SET_NAME(g_bssrdf);
     }
+
+    { // g_blue_noise_mask
+        Array<float> mask = Bluenoise::generate_mask(BLUE_NOISE_MASK_SIZE);
+        g_blue_noise_mask = create_buffer_and_write_contents(cmd_list, mask, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, NULL);
+        SET_NAME(g_blue_noise_mask);
+        array_free(&mask);
+    }
+
+    { // g_compact_payload_error
+        g_compact_payload_error = Translucent::rgb9e5_error();
+#ifdef DEBUG
+        // each channel rounds to within half a unit of the largest channel's mantissa, which is at least 256
+        if (g_compact_payload_error > 1.001f / 512) abort();
+#endif
+    }
+
+    { // g_path_queue_counts_reset
+        UINT32 zeroes[max(PATH_QUEUES_COUNT, FRAME_STATISTICS_COUNT)] = {};
+        g_path_queue_counts_reset = create_buffer_and_write_contents(cmd_list, VLA_VIEW(zeroes), D3D12_RESOURCE_STATE_COPY_SOURCE, NULL);
+        SET_NAME(g_path_queue_counts_reset);
+    }
+
+    { // g_dispatch_rays_signature
+        D3D12_INDIRECT_ARGUMENT_DESC argument = {};
+        argument.Type = D3D12_INDIRECT_ARGUMENT_TYPE_DISPATCH_RAYS;
+
+        D3D12_COMMAND_SIGNATURE_DESC desc = {};
+        desc.ByteStride       = sizeof(D3D12_DISPATCH_RAYS_DESC);
+        desc.NumArgumentDescs = 1;
+        desc.pArgumentDescs   = &argument;
+        CHECK_RESULT(g_device->CreateCommandSignature(&desc, NULL, IID_PPV_ARGS(&g_dispatch_rays_signature)));
+        SET_NAME(g_dispatch_rays_signature);
+    }
+
+    { // g_radiance_cache_keys, g_radiance_cache_values
+        g_radiance_cache_keys   = create_buffer(RADIANCE_CACHE_CAPACITY*sizeof(UINT32),   D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+        g_radiance_cache_values = create_buffer(RADIANCE_CACHE_CAPACITY*sizeof(XMUINT4),  D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+        SET_NAME(g_radiance_cache_keys);
+        SET_NAME(g_radiance_cache_values);
+    }
+
+    { // g_frame_statistics, g_frame_statistics_readback
+        g_frame_statistics          = create_buffer(FRAME_STATISTICS_COUNT*sizeof(UINT32), D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+        g_frame_statistics_readback = create_buffer(FRAME_STATISTICS_COUNT*sizeof(UINT32), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_HEAP_TYPE_READBACK);
+        SET_NAME(g_frame_statistics);
+        SET_NAME(g_frame_statistics_readback);
+    }
+
+    { // g_guiding_records, g_guiding_records_count, g_guiding_records_readback, g_guiding_records_count_readback
+        g_guiding_records                = create_buffer(GUIDING_RECORDS_CAPACITY*sizeof(GuidingRecord), D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+        g_guiding_records_count          = create_buffer(sizeof(UINT32),                                 D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+        g_guiding_records_readback       = create_buffer(GUIDING_RECORDS_CAPACITY*sizeof(GuidingRecord), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_HEAP_TYPE_READBACK);
+        g_guiding_records_count_readback = create_buffer(sizeof(UINT32),                                 D3D12_RESOURCE_STATE_COPY_DEST, D3D12_HEAP_TYPE_READBACK);
+        SET_NAME(g_guiding_records);
+        SET_NAME(g_guiding_records_count);
+        SET_NAME(g_guiding_records_readback);
+        SET_NAME(g_guiding_records_count_readback);
+    }
+
+    { // g_timestamp_query_heap, g_timestamp_readback
+        D3D12_QUERY_HEAP_DESC desc = {};
+        desc.Type  = D3D12_QUERY_HEAP_TYPE_TIMESTAMP;
+        desc.Count = 2;
+        CHECK_RESULT(g_device->CreateQueryHeap(&desc, IID_PPV_ARGS(&g_timestamp_query_heap)));
+
+        g_timestamp_readback = create_buffer(desc.Count*sizeof(UINT64), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_HEAP_TYPE_READBACK);
+        SET_NAME(g_timestamp_readback);
+    }
+}
+
+// must be called after the previous frame's command list has finished executing
+void read_frame_statistics(ID3D12CommandQueue* cmd_queue) {
+    UINT64 frequency;
+    CHECK_RESULT(cmd_queue->GetTimestampFrequency(&frequency));
+
+    UINT64 timestamps[2] = {};
+    copy_from_readback_buffer(VLA_VIEW(timestamps), g_timestamp_readback);
+    if (timestamps[1] > timestamps[0]) {
+        g_render_milliseconds = 1000.0 * (double) (timestamps[1] - timestamps[0]) / (double) frequency;
+    }
+
+    UINT32 statistics[FRAME_STATISTICS_COUNT] = {};
+    copy_from_readback_buffer(VLA_VIEW(statistics), g_frame_statistics_readback);
+
+    double samples_count = (double) g_render_width*g_render_height*max(g_globals.samples_per_pixel, 1);
+    g_rays_per_sample = statistics[FRAME_STATISTICS_RAY_COUNT] / samples_count; // includes the translucent sample point update when it is enabled
+
+    // only measured by the megakernel integrator, with more than one sample per pixel
+    UINT64 variance = (UINT64) statistics[FRAME_STATISTICS_PIXEL_VARIANCE + 1] << 32 | statistics[FRAME_STATISTICS_PIXEL_VARIANCE];
+    g_pixel_variance = variance / FRAME_STATISTICS_FIXED_POINT / ((double) g_render_width*g_render_height);
 }
 
 void update_resolution(UINT width, UINT height) {
     g_width  = width;
     g_height = height;
+    g_render_width  = width;
+    g_render_height = height;
 
     // common render target configuration
     D3D12_RESOURCE_DESC rt_resource_desc = {};
@@ -184,6 +506,93 @@ void update_resolution(UINT width, UINT height) {
             IID_PPV_ARGS(&g_sample_accumulator)
         ));
     }
+
+    { // g_sample_counts
+        if (g_sample_counts) g_sample_counts->Release();
+
+        D3D12_RESOURCE_DESC resource_desc = rt_resource_desc;
+        resource_desc.Format              = DXGI_FORMAT_R32_FLOAT;
+
+        CHECK_RESULT(g_device->CreateCommittedResource(
+            &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT), D3D12_HEAP_FLAG_NONE,
+            &resource_desc, D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
+            NULL,
+            IID_PPV_ARGS(&g_sample_counts)
+        ));
+    }
+
+    { // reprojection state and first hit AOVs
+        Triplet<ID3D12Resource**, DXGI_FORMAT, bool> textures[] = { // texture, format, enabled
+            { &g_first_hits,          DXGI_FORMAT_R32G32B32A32_FLOAT, g_enable_reprojection || (g_aovs & AOV_NORMAL_DEPTH) },
+            { &g_history_accumulator, DXGI_FORMAT_R32G32B32A32_FLOAT, g_enable_reprojection                                },
+            { &g_history_first_hits,  DXGI_FORMAT_R32G32B32A32_FLOAT, g_enable_reprojection                                },
+            { &g_history_counts,      DXGI_FORMAT_R32_FLOAT,          g_enable_reprojection                                },
+            { &g_first_hit_albedo,    DXGI_FORMAT_R16G16B16A16_FLOAT, (g_aovs & AOV_ALBEDO) != 0                           },
+            { &g_first_hit_ids,       DXGI_FORMAT_R32G32_UINT,        (g_aovs & AOV_IDS) != 0                              },
+        };
+        for (auto& texture : textures) {
+            if (*texture._0) (*texture._0)->Release();
+            *texture._0 = NULL;
+
+            if (texture._2) {
+                D3D12_RESOURCE_DESC resource_desc = rt_resource_desc;
+                resource_desc.Format              = texture._1;
+
+                CHECK_RESULT(g_device->CreateCommittedResource(
+                    &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT), D3D12_HEAP_FLAG_NONE,
+                    &resource_desc, D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
+                    NULL,
+                    IID_PPV_ARGS(texture._0)
+                ));
+            }
+        }
+        if (g_first_hits)          SET_NAME(g_first_hits);
+        if (g_enable_reprojection) {
+            SET_NAME(g_history_accumulator);
+            SET_NAME(g_history_first_hits);
+            SET_NAME(g_history_counts);
+        }
+        if (g_first_hit_albedo)    SET_NAME(g_first_hit_albedo);
+        if (g_first_hit_ids)       SET_NAME(g_first_hit_ids);
+    }
+
+    { // wavefront path state
+        ID3D12Resource** path_buffers[] = {
+            &g_path_origins, &g_path_directions, &g_path_throughputs, &g_path_radiances, &g_path_rngs,
+            &g_path_queues, &g_path_queue_counts, &g_path_first_hits, &g_path_hits, &g_path_dispatches, &g_path_dispatches_upload,
+        };
+        for (auto buffer : path_buffers) {
+            if (*buffer) (*buffer)->Release();
+            *buffer = NULL;
+        }
+
+        if (g_enable_wavefront) {
+            UINT64 paths_count = g_width*g_height;
+
+            g_path_origins      = create_buffer(paths_count*sizeof(XMFLOAT3), D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+            g_path_directions   = create_buffer(paths_count*sizeof(XMFLOAT4), D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+            g_path_throughputs  = create_buffer(paths_count*sizeof(XMFLOAT4), D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+            g_path_radiances    = create_buffer(paths_count*sizeof(XMFLOAT4), D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+            g_path_rngs         = create_buffer(paths_count*sizeof(XMUINT4),  D3D12_RESOURCE_STATE_UNORDERED_ACCESS); // Sampler
+            g_path_queues       = create_buffer(PATH_QUEUES_COUNT*paths_count*sizeof(UINT32), D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+            g_path_queue_counts = create_buffer(PATH_QUEUES_COUNT*sizeof(UINT32),             D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+            g_path_first_hits   = create_buffer(paths_count*sizeof(FirstHit), D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+            g_path_hits         = create_buffer(paths_count*sizeof(PathHit),  D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+            g_path_dispatches        = create_buffer(PATH_QUEUES_COUNT*sizeof(D3D12_DISPATCH_RAYS_DESC), D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT);
+            g_path_dispatches_upload = create_buffer(PATH_QUEUES_COUNT*sizeof(D3D12_DISPATCH_RAYS_DESC), D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_HEAP_TYPE_UPLOAD);
+            SET_NAME(g_path_origins);
+            SET_NAME(g_path_directions);
+            SET_NAME(g_path_throughputs);
+            SET_NAME(g_path_radiances);
+            SET_NAME(g_path_rngs);
+            SET_NAME(g_path_queues);
+            SET_NAME(g_path_queue_counts);
+            SET_NAME(g_path_first_hits);
+            SET_NAME(g_path_hits);
+            SET_NAME(g_path_dispatches);
+            SET_NAME(g_path_dispatches_upload);
+        }
+    }
 }
 
 UINT update_descriptors(DescriptorHandle dest_array) {
@@ -202,6 +611,10 @@ UINT update_descriptors(DescriptorHandle dest_array) {
         // g_sample_accumulator
         g_device->CreateUnorderedAccessView(g_sample_accumulator, NULL, NULL, dest_array + descriptors_count);
         descriptors_count += 1;
+
+        // g_sample_counts
+        g_device->CreateUnorderedAccessView(g_sample_counts, NULL, NULL, dest_array + descriptors_count);
+        descriptors_count += 1;
     }
 
     // g_scene
@@ -229,28 +642,33 @@ UINT update_descriptors(DescriptorHandle dest_array) {
             g_device->CreateShaderResourceView(g_translucent_properties_buffer, &desc, dest_array + descriptors_count);
         } descriptors_count += 1;
 
-        {   // g_translucent_samples
+        {   // g_translucent_positions, g_translucent_payloads
             D3D12_SHADER_RESOURCE_VIEW_DESC desc = {};
             desc.Format                  = DXGI_FORMAT_UNKNOWN;
             desc.ViewDimension           = D3D12_SRV_DIMENSION_BUFFER;
             desc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
 
             desc.Buffer.FirstElement        = 0;
-            desc.Buffer.StructureByteStride = sizeof(SamplePoint);
 
             // initialize array with null descriptors
-            for (UINT i = 0; i < array_size; i++) {
+            for (UINT i = 0; i < 2*array_size; i += 2) {
+                desc.Buffer.StructureByteStride = sizeof(XMFLOAT3);
+                g_device->CreateShaderResourceView(NULL, &desc, dest_array+descriptors_count + i);
+                desc.Buffer.StructureByteStride = sizeof(XMFLOAT4);
                 g_device->CreateShaderResourceView(NULL, &desc, dest_array+descriptors_count + i + 1);
             }
 
-            // populate valid descriptors
+            // populate valid descriptors, the mesh's positions are duplicated for each of its instances
             for (auto& instance : g_translucent_instances) {
-                UINT index = instance.translucent_id * g_globals.translucent_instance_stride + instance.instance_id;
+                UINT index = instance.translucent_id * 2*g_globals.translucent_instance_stride + 2*instance.instance_id;
 
                 desc.Buffer.NumElements = instance.samples_count;
-                g_device->CreateShaderResourceView(instance.sample_points_buffer, &desc, dest_array+descriptors_count + index);
+                desc.Buffer.StructureByteStride = sizeof(XMFLOAT3);
+                g_device->CreateShaderResourceView(g_translucent_meshes[instance.translucent_id].positions_buffer, &desc, dest_array+descriptors_count + index);
+                desc.Buffer.StructureByteStride = sizeof(XMFLOAT4);
+                g_device->CreateShaderResourceView(instance.payloads_buffer,                                      &desc, dest_array+descriptors_count + index + 1);
             }
-            descriptors_count += array_size;
+            descriptors_count += 2*array_size;
         }
     }
 
@@ -271,7 +689,7 @@ UINT update_descriptors(DescriptorHandle dest_array) {
         }
         descriptors_count += 1;
 
-        // g_write_translucent_samples, g_point_normals
+        // g_write_translucent_payloads, g_point_normals
         UINT array_size = g_translucent_meshes.len * 2*g_globals.translucent_instance_stride;
 
         D3D12_UNORDERED_ACCESS_VIEW_DESC uav_desc = {};
@@ -280,7 +698,7 @@ UINT update_descriptors(DescriptorHandle dest_array) {
 
         uav_desc.Buffer.FirstElement        = 0;
         uav_desc.Buffer.NumElements         = 0;
-        uav_desc.Buffer.StructureByteStride = sizeof(SamplePoint);
+        uav_desc.Buffer.StructureByteStride = sizeof(XMFLOAT4);
 
         D3D12_SHADER_RESOURCE_VIEW_DESC srv_desc = {};
         srv_desc.Format                  = DXGI_FORMAT_UNKNOWN;
@@ -304,12 +722,128 @@ UINT update_descriptors(DescriptorHandle dest_array) {
 
             uav_desc.Buffer.NumElements = instance.samples_count;
             srv_desc.Buffer.NumElements = instance.samples_count;
-            g_device->CreateUnorderedAccessView(instance.write_sample_points_buffer, NULL, &uav_desc, dest_array+descriptors_count + index);
-            g_device->CreateShaderResourceView( instance.point_normals_buffer,             &srv_desc, dest_array+descriptors_count + index + 1);
+            g_device->CreateUnorderedAccessView(instance.write_payloads_buffer,                                  NULL, &uav_desc, dest_array+descriptors_count + index);
+            g_device->CreateShaderResourceView( g_translucent_meshes[instance.translucent_id].point_normals_buffer, &srv_desc, dest_array+descriptors_count + index + 1);
         }
         descriptors_count += array_size;
     }
 
+    // wavefront constants are set per dispatch
+    array_push(&g_root_args, {});
+
+    // wavefront descriptor table
+    array_push(&g_root_args, RootArgument::descriptor_table(dest_array + descriptors_count)); {
+        UINT64 paths_count = g_width*g_height;
+
+        Pair<ID3D12Resource*, UINT64> buffers[] = { // buffer, element stride
+            { g_path_origins,      sizeof(XMFLOAT3) },
+            { g_path_directions,   sizeof(XMFLOAT4) },
+            { g_path_throughputs,  sizeof(XMFLOAT4) },
+            { g_path_radiances,    sizeof(XMFLOAT4) },
+            { g_path_rngs,         sizeof(XMUINT4)  },
+            { g_path_queues,       sizeof(UINT32)   },
+            { g_path_queue_counts, sizeof(UINT32)   },
+            { g_path_first_hits,   sizeof(FirstHit) },
+            { g_path_hits,         sizeof(PathHit)  },
+        };
+        for (auto& buffer : buffers) {
+            D3D12_UNORDERED_ACCESS_VIEW_DESC desc = {};
+            desc.Format        = DXGI_FORMAT_UNKNOWN;
+            desc.ViewDimension = D3D12_UAV_DIMENSION_BUFFER;
+
+            desc.Buffer.FirstElement        = 0;
+            desc.Buffer.NumElements         = buffer._0 ? buffer._0->GetDesc().Width / buffer._1 : 0; // null descriptor if disabled
+            desc.Buffer.StructureByteStride = buffer._1;
+
+            g_device->CreateUnorderedAccessView(buffer._0, NULL, &desc, dest_array + descriptors_count);
+            descriptors_count += 1;
+        }
+    }
+
+    // g_emitters
+    if (g_emitters_buffer) array_push(&g_root_args, RootArgument::srv(g_emitters_buffer->GetGPUVirtualAddress()));
+    else                   array_push(&g_root_args, {});
+
+    // g_blue_noise_mask
+    array_push(&g_root_args, RootArgument::srv(g_blue_noise_mask->GetGPUVirtualAddress()));
+
+    // g_radiance_cache_keys, g_radiance_cache_values
+    array_push(&g_root_args, RootArgument::uav(g_radiance_cache_keys->GetGPUVirtualAddress()));
+    array_push(&g_root_args, RootArgument::uav(g_radiance_cache_values->GetGPUVirtualAddress()));
+
+    // g_frame_statistics
+    array_push(&g_root_args, RootArgument::uav(g_frame_statistics->GetGPUVirtualAddress()));
+
+    // guiding trees are set per frame
+    array_push(&g_root_args, {});
+    array_push(&g_root_args, {});
+
+    // g_guiding_records, g_guiding_records_count
+    array_push(&g_root_args, RootArgument::uav(g_guiding_records->GetGPUVirtualAddress()));
+    array_push(&g_root_args, RootArgument::uav(g_guiding_records_count->GetGPUVirtualAddress()));
+
+    // reprojection descriptor table
+    array_push(&g_root_args, RootArgument::descriptor_table(dest_array + descriptors_count)); {
+        Pair<ID3D12Resource*, DXGI_FORMAT> textures[] = { // texture, format of the null descriptor if disabled
+            { g_first_hits,          DXGI_FORMAT_R32G32B32A32_FLOAT },
+            { g_history_accumulator, DXGI_FORMAT_R32G32B32A32_FLOAT },
+            { g_history_first_hits,  DXGI_FORMAT_R32G32B32A32_FLOAT },
+            { g_history_counts,      DXGI_FORMAT_R32_FLOAT          },
+            { g_first_hit_albedo,    DXGI_FORMAT_R16G16B16A16_FLOAT },
+            { g_first_hit_ids,       DXGI_FORMAT_R32G32_UINT        },
+        };
+        for (auto& texture : textures) {
+            D3D12_UNORDERED_ACCESS_VIEW_DESC desc = {};
+            desc.Format        = texture._1;
+            desc.ViewDimension = D3D12_UAV_DIMENSION_TEXTURE2D;
+
+            g_device->CreateUnorderedAccessView(texture._0, NULL, &desc, dest_array + descriptors_count);
+            descriptors_count += 1;
+        }
+    }
+
+    // tile constants are set per dispatch
+    array_push(&g_root_args, {});
+
+    // g_translucent_nodes, g_translucent_point_indices, g_translucent_node_flux
+    if (g_translucent_nodes_buffer) {
+        array_push(&g_root_args, RootArgument::srv(g_translucent_nodes_buffer->GetGPUVirtualAddress()));
+        array_push(&g_root_args, RootArgument::srv(g_translucent_point_indices_buffer->GetGPUVirtualAddress()));
+        array_push(&g_root_args, RootArgument::uav(g_translucent_node_flux_buffer->GetGPUVirtualAddress()));
+    } else {
+        array_push(&g_root_args, {});
+        array_push(&g_root_args, {});
+        array_push(&g_root_args, {});
+    }
+
+    // refit constants are set per dispatch
+    array_push(&g_root_args, {});
+
+    // g_translucent_grid_cells, g_translucent_grid_point_indices
+    if (g_translucent_grid_cells_buffer) {
+        array_push(&g_root_args, RootArgument::srv(g_translucent_grid_cells_buffer->GetGPUVirtualAddress()));
+        array_push(&g_root_args, RootArgument::srv(g_translucent_grid_point_indices_buffer->GetGPUVirtualAddress()));
+    } else {
+        array_push(&g_root_args, {});
+        array_push(&g_root_args, {});
+    }
+
+    // g_dipole_lut
+    array_push(&g_root_args, RootArgument::srv(g_dipole_lut->GetGPUVirtualAddress()));
+
+    // g_translucent_grid_positions, g_translucent_grid_payloads
+    if (g_translucent_grid_positions_buffer) {
+        array_push(&g_root_args, RootArgument::srv(g_translucent_grid_positions_buffer->GetGPUVirtualAddress()));
+        array_push(&g_root_args, RootArgument::uav(g_translucent_grid_payloads_buffer->GetGPUVirtualAddress()));
+    } else {
+        array_push(&g_root_args, {});
+        array_push(&g_root_args, {});
+    }
+
+    // g_translucent_photon_flux
+    if (g_translucent_photon_flux_buffer) array_push(&g_root_args, RootArgument::uav(g_translucent_photon_flux_buffer->GetGPUVirtualAddress()));
+    else                                  array_push(&g_root_args, {});
+
     return descriptors_count;
 }
 
@@ -322,6 +856,8 @@ Blas build_blas(
     blas.shader_table_index    = g_shader_table.len;
     blas.translucent_ids_index = g_translucent_properties.len;
     blas.translucent_ids_count = 0;
+    blas.emitters_index        = g_blas_emitters.len;
+    blas.emitters_count        = 0;
 
     Array<Vertex> vertices = {};
     Array<Index>  indices  = {};
@@ -357,6 +893,23 @@ Blas build_blas(
         };
         array_push(&geometry_descs, desc);
 
+        // collect emitter triangles for light sampling
+        if (geometry.material.shader == Shader::Light) {
+            for (UINT i = 0; i + 2 < geometry.indices.len; i += 3) {
+                XMVECTOR p0 = XMLoadFloat3(&geometry.vertices[geometry.indices[i+0]].position);
+                XMVECTOR p1 = XMLoadFloat3(&geometry.vertices[geometry.indices[i+1]].position);
+                XMVECTOR p2 = XMLoadFloat3(&geometry.vertices[geometry.indices[i+2]].position);
+
+                EmitterTriangle emitter = {};
+                XMStoreFloat3(&emitter.position, p0);
+                XMStoreFloat3(&emitter.edge1,    p1 - p0);
+                XMStoreFloat3(&emitter.edge2,    p2 - p0);
+                emitter.color = geometry.material.color;
+                array_push(&g_blas_emitters, emitter);
+            }
+            blas.emitters_count = g_blas_emitters.len - blas.emitters_index;
+        }
+
         // concat mesh data, taking into account combined mesh offset
         array_reserve(&indices, geometry.indices.len);
         for (auto& index : geometry.indices) {
@@ -443,24 +996,47 @@ Blas build_blas(
     return blas;
 }
 
+// scale of transform's linear part, which must scale uniformly: the translucent gather measures object space distances by it
+inline float uniform_scale(XMFLOAT4X4* transform) {
+    float lengths[3];
+    for (UINT i = 0; i < 3; i++) {
+        lengths[i] = XMVectorGetX(XMVector3Length(XMLoadFloat3((XMFLOAT3*) &transform->m[i])));
+    }
+    float scale = lengths[0];
+    if (fabsf(lengths[1] - scale) > 1e-4f*scale || fabsf(lengths[2] - scale) > 1e-4f*scale) abort();
+    return scale;
+}
+
+// release a mesh's sample points, with the octree and grid built over them
+void release_sample_points(TranslucentMesh* mesh) {
+    mesh->positions_buffer->Release();
+    mesh->point_normals_buffer->Release();
+    Translucent::free_octree(&mesh->octree);
+    Translucent::free_grid(&mesh->grid);
+    array_free(&mesh->grid_positions);
+    mesh->samples_count = 0;
+}
+
 void build_tlas(
     ID3D12GraphicsCommandList4* cmd_list,
     ArrayView<BlasInstance> instances,
     Array<ID3D12Resource*>* temp_resources
 ) {
-    // reset translucent mesh instances
+    // reset translucent mesh instances, the meshes keep their sample points
     for (auto& instance : g_translucent_instances) {
         if (!instance.samples_count) continue;
 
-        instance.sample_points_buffer->Release();
-        instance.write_sample_points_buffer->Release();
-        instance.point_normals_buffer->Release();
+        instance.payloads_buffer->Release();
+        instance.write_payloads_buffer->Release();
     }
     g_translucent_instances.len           = 0;
     g_max_translucent_samples_count       = 0;
     g_globals.translucent_instance_stride = 0;
+    g_fixed_color_emitters                = false;
 
     Array<Pair<UINT, UINT>> blas_instance_counts      = {}; // blas->shader_table_index -> blas instance counts
+    Array<EmitterTriangle>  emitters                  = {};
+    float                   emitters_total_area       = 0;
 
     // instance descs for tlas build
     MappedView<D3D12_RAYTRACING_INSTANCE_DESC> descs = array_init_mapped_upload_buffer<D3D12_RAYTRACING_INSTANCE_DESC>(instances.len);
@@ -486,11 +1062,40 @@ void build_tlas(
                 translucent->instance_id    = instance_id; // NOTE: assumes translucent instantiations = blas instantiations => no overlap in blas translucent ranges
 
                 translucent->transform      = instance->transform;
+                translucent->scale_factor   = uniform_scale(&instance->transform);
             }
             // update stride to fit duplicated translucent meshes
             g_globals.translucent_instance_stride = max(g_globals.translucent_instance_stride, *count);
         }
 
+        if (instance->blas->emitters_count > 0) {
+            // instantiate emitter triangles in world space
+            XMMATRIX transform = XMLoadFloat4x4(&instance->transform);
+            float    winding   = XMVectorGetX(XMMatrixDeterminant(transform)) < 0 ? -1 : 1; // mirrored instances flip the emitting side
+
+            for (UINT j = 0; j < instance->blas->emitters_count; j++) {
+                EmitterTriangle emitter = g_blas_emitters[instance->blas->emitters_index + j];
+
+                XMVECTOR position = XMVector3Transform      (XMLoadFloat3(&emitter.position), transform);
+                XMVECTOR edge1    = XMVector3TransformNormal(XMLoadFloat3(&emitter.edge1),    transform);
+                XMVECTOR edge2    = XMVector3TransformNormal(XMLoadFloat3(&emitter.edge2),    transform);
+                XMVECTOR cross    = XMVector3Cross(edge1, edge2) * winding;
+
+                float area = 0.5 * XMVectorGetX(XMVector3Length(cross));
+                if (area <= 0) continue;
+                emitters_total_area += area;
+
+                XMStoreFloat3(&emitter.position, position);
+                XMStoreFloat3(&emitter.edge1,    edge1);
+                XMStoreFloat3(&emitter.edge2,    edge2);
+                XMStoreFloat3(&emitter.normal,   XMVector3Normalize(cross));
+                emitter.cdf = emitters_total_area;
+                array_push(&emitters, emitter);
+
+                g_fixed_color_emitters |= emitter.color.x != 0 || emitter.color.y != 0 || emitter.color.z != 0;
+            }
+        }
+
         // create ratracing instance desc
         D3D12_RAYTRACING_INSTANCE_DESC desc = {}; {
             desc.InstanceMask = 1;
@@ -508,13 +1113,22 @@ void build_tlas(
     array_unmap_resource(&descs);
     Device::push_temp_resource(descs.resource, temp_resources);
 
+    // upload emitter table
+    if (g_emitters_buffer) g_emitters_buffer->Release();
+    g_emitters_buffer = NULL;
+    if (emitters.len > 0) {
+        g_emitters_buffer = create_buffer_and_write_contents(cmd_list, emitters, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, Device::push_uninitialized_temp_resource(temp_resources));
+        SET_NAME(g_emitters_buffer);
+    }
+    g_globals.emitters_count      = emitters.len;
+    g_globals.emitters_total_area = emitters_total_area;
+    array_free(&emitters);
+
     // upload shader table
     if (g_shader_table_buffer) g_shader_table_buffer->Release();
     if (g_shader_table.len > 0) {
-        g_camera_rgen_shader_record      = create_buffer_and_write_contents(cmd_list, array_of(&Raytracing::g_camera_rgen),      D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, NULL);
-        g_translucent_rgen_shader_record = create_buffer_and_write_contents(cmd_list, array_of(&Raytracing::g_translucent_rgen), D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, NULL);
-        g_miss_shader_table              = create_buffer_and_write_contents(cmd_list, array_of(&Raytracing::g_miss),             D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, NULL);
-        g_hit_group_shader_table         = create_buffer_and_write_contents(cmd_list, g_shader_table,                            D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, NULL);
+        if (g_hit_group_shader_table) g_hit_group_shader_table->Release();
+        g_hit_group_shader_table = create_buffer_and_write_contents(cmd_list, g_shader_table, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, NULL);
 
         g_shader_table_buffer = create_buffer_and_write_contents(cmd_list, g_shader_table, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, Device::push_uninitialized_temp_resource(temp_resources));
     }
@@ -556,6 +1170,160 @@ UINT generate_translucent_samples(ID3D12GraphicsCommandList4* cmd_list, float ra
     UINT total_sample_points = 0;
     g_max_translucent_samples_count = 0;
 
+    // the grid's positions and payloads are quantized to 64 bits and RGB9E5 if compact
+    g_globals.translucent_compact_samples = g_compact_sample_points;
+    UINT64 payload_size = g_compact_sample_points ? sizeof(UINT32) : sizeof(XMFLOAT3);
+
+    // generate the sample points of each mesh in object space, as dense as its largest instance needs
+    Array<SamplePoint> points         = {};
+    Array<XMFLOAT3>    normals        = {};
+    Array<UINT>        order          = {};
+    Array<SamplePoint> sorted_points  = {};
+    Array<XMFLOAT3>    sorted_normals = {};
+    Array<XMFLOAT3>    positions      = {};
+    XMFLOAT4X4 identity;
+    XMStoreFloat4x4(&identity, XMMatrixIdentity());
+
+    for (UINT i = 0; i < g_translucent_meshes.len; i++) {
+        TranslucentMesh* mesh = &g_translucent_meshes[i];
+
+        float max_scale = 0;
+        for (auto& instance : g_translucent_instances) {
+            if (instance.translucent_id == i) max_scale = max(max_scale, instance.scale_factor);
+        }
+        if (max_scale == 0) {
+            // not instantiated anymore
+            if (mesh->samples_count) release_sample_points(mesh);
+            continue;
+        }
+
+        // keep the sample points of meshes whose density and layout are unchanged
+        float mesh_radius = radius / max_scale;
+        if (mesh->samples_count && mesh->radius == mesh_radius && mesh->compact == g_compact_sample_points && mesh->morton_ordered == g_morton_order_sample_points) continue;
+
+        // release previous generation's resources
+        if (mesh->samples_count) release_sample_points(mesh);
+
+        ID3D12Resource* sample_points_buffer = NULL;
+        ID3D12Resource* point_normals_buffer = NULL;
+        mesh->samples_count = Bluenoise::generate_sample_points(
+            &sample_points_buffer,
+            &point_normals_buffer,
+            NULL,
+
+            &mesh->preprocess,
+            mesh->ib, mesh->ib_offset,
+            mesh->vb,
+            &identity,
+            mesh_radius,
+            &points,
+            &normals
+        );
+        // reuploaded below as positions only and in Morton order
+        sample_points_buffer->Release();
+        point_normals_buffer->Release();
+
+        mesh->radius         = mesh_radius;
+        mesh->compact        = g_compact_sample_points;
+        mesh->morton_ordered = g_morton_order_sample_points;
+
+        if (g_morton_order_sample_points) {
+            // sort the sample points and their normals along a Morton curve, so that neighbouring points are nearby in memory
+            Translucent::morton_order(&order, points);
+
+            sorted_points.len  = 0;
+            sorted_normals.len = 0;
+            for (auto j : order) {
+                array_push(&sorted_points,  points[j]);
+                array_push(&sorted_normals, normals[j]);
+            }
+            Prelude::swap(&points,  &sorted_points);
+            Prelude::swap(&normals, &sorted_normals);
+        }
+
+        positions.len = 0;
+        for (auto& point : points) array_push(&positions, point.position);
+        mesh->positions_buffer     = create_buffer_and_write_contents(cmd_list, positions, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, Device::push_uninitialized_temp_resource(temp_resources));
+        mesh->point_normals_buffer = create_buffer_and_write_contents(cmd_list, normals,   D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, Device::push_uninitialized_temp_resource(temp_resources));
+        mesh->positions_buffer->SetName(L"translucent_positions");
+        mesh->point_normals_buffer->SetName(L"point_normals");
+
+        // octree and grid of a few points per cell, in object space
+        float point_area = mesh->preprocess.total_surface_area / mesh->samples_count;
+        Translucent::build_octree(&mesh->octree, points, point_area);
+        Translucent::build_grid(&mesh->grid, points, TRANSLUCENT_GRID_CELL_SPACINGS * sqrtf(point_area));
+
+        mesh->position_error = 0;
+        for (auto j : mesh->grid.point_indices) {
+            XMFLOAT3 position = points[j].position;
+            if (g_compact_sample_points) {
+                XMUINT2 encoded = Translucent::encode_position(&mesh->grid, position);
+                array_push(&mesh->grid_positions, encoded.x);
+                array_push(&mesh->grid_positions, encoded.y);
+
+                XMFLOAT3 decoded = Translucent::decode_position(&mesh->grid, encoded);
+                mesh->position_error = max(mesh->position_error, XMVectorGetX(XMVector3Length(XMLoadFloat3(&decoded) - XMLoadFloat3(&position))));
+#ifdef DEBUG
+                if (mesh->position_error > Translucent::position_error_bound(&mesh->grid)) abort(); // beyond half a quantization step
+#endif
+            } else {
+                memcpy(array_push_uninitialized(&mesh->grid_positions, 3).ptr, &position, sizeof(position));
+            }
+        }
+    }
+    array_free(&points);
+    array_free(&normals);
+    array_free(&order);
+    array_free(&sorted_points);
+    array_free(&sorted_normals);
+    array_free(&positions);
+
+    // concatenate the octrees and grids of all meshes
+    Array<TranslucentNode> nodes              = {};
+    Array<UINT>            point_indices      = {};
+    Array<UINT>            grid_cells         = {};
+    Array<UINT>            grid_point_indices = {};
+    Array<UINT>            grid_positions     = {};
+    memset(g_translucent_level_widths, 0, sizeof(g_translucent_level_widths));
+    g_translucent_levels_count = 0;
+    g_compact_position_error   = 0;
+
+    for (UINT i = 0; i < g_translucent_meshes.len; i++) {
+        TranslucentMesh*       mesh       = &g_translucent_meshes[i];
+        TranslucentProperties* properties = &g_translucent_properties[i];
+        if (!mesh->samples_count) continue;
+
+        TranslucentOctree* octree = &mesh->octree;
+        properties->nodes_offset         = nodes.len;
+        properties->point_indices_offset = point_indices.len;
+        properties->octree_levels_count  = octree->levels_count;
+        for (UINT l = 0; l <= octree->levels_count; l++) properties->octree_level_offsets[l] = octree->level_offsets[l];
+        for (UINT l = 0; l <  octree->levels_count; l++) {
+            g_translucent_level_widths[l] = max(g_translucent_level_widths[l], octree->level_offsets[l + 1] - octree->level_offsets[l]);
+        }
+        g_translucent_levels_count = max(g_translucent_levels_count, octree->levels_count);
+
+        ArrayView<TranslucentNode> nodes_dst         = array_push_uninitialized(&nodes,         octree->nodes.len);
+        ArrayView<UINT>            point_indices_dst = array_push_uninitialized(&point_indices, octree->point_indices.len);
+        array_copy_nonoverlapping(&nodes_dst,         &octree->nodes);
+        array_copy_nonoverlapping(&point_indices_dst, &octree->point_indices);
+
+        TranslucentGrid* grid = &mesh->grid;
+        properties->grid_origin               = grid->origin;
+        properties->grid_cell_size            = grid->cell_size;
+        properties->grid_dimensions           = grid->dimensions;
+        properties->grid_cells_offset         = grid_cells.len;
+        properties->grid_point_indices_offset = grid_point_indices.len;
+
+        ArrayView<UINT> grid_cells_dst         = array_push_uninitialized(&grid_cells,         grid->cells.len);
+        ArrayView<UINT> grid_point_indices_dst = array_push_uninitialized(&grid_point_indices, grid->point_indices.len);
+        ArrayView<UINT> grid_positions_dst     = array_push_uninitialized(&grid_positions,     mesh->grid_positions.len);
+        array_copy_nonoverlapping(&grid_cells_dst,         &grid->cells);
+        array_copy_nonoverlapping(&grid_point_indices_dst, &grid->point_indices);
+        array_copy_nonoverlapping(&grid_positions_dst,     &mesh->grid_positions);
+        g_compact_position_error = max(g_compact_position_error, mesh->position_error);
+    }
+
     // upload translucent properties in instanced array layout
     if (g_translucent_properties_buffer) g_translucent_properties_buffer->Release();
     MappedView<TranslucentProperties> properties_upload = array_init_mapped_upload_buffer<TranslucentProperties>(g_translucent_properties.len * g_globals.translucent_instance_stride);
@@ -563,64 +1331,49 @@ UINT generate_translucent_samples(ID3D12GraphicsCommandList4* cmd_list, float ra
     // log indices of translucent instances for sample collection
     MappedView<UINT> write_translucent_indices = array_init_mapped_upload_buffer<UINT>(g_translucent_instances.len);
 
-    // batch clone sample points buffer for write target
-    Array<D3D12_RESOURCE_BARRIER>                            pre_copy  = array_init<D3D12_RESOURCE_BARRIER>(g_translucent_instances.len);
-    Array<D3D12_RESOURCE_BARRIER>                            post_copy = array_init<D3D12_RESOURCE_BARRIER>(2*g_translucent_instances.len);
-    Array<Triplet<ID3D12Resource*, ID3D12Resource*, UINT64>> copies    = array_init<Triplet<ID3D12Resource*, ID3D12Resource*, UINT64>>(g_translucent_instances.len);
+    // allocate the payloads of each instance, with its ranges of the node flux and grid payloads
+    Array<XMFLOAT4> zeros               = {};
+    UINT            node_flux_count     = 0;
+    UINT            grid_payloads_count = 0;
 
     for (UINT i = 0; i < g_translucent_instances.len; i++) {
-        TranslucentInstance*   instance   = &g_translucent_instances[i];
-
-        TranslucentMesh*       mesh       = &g_translucent_meshes[instance->translucent_id];
-        TranslucentProperties* properties = &g_translucent_properties[instance->translucent_id];
+        TranslucentInstance* instance = &g_translucent_instances[i];
+        TranslucentMesh*     mesh     = &g_translucent_meshes[instance->translucent_id];
 
         if (instance->samples_count) {
             // release previous instances' resources
-            instance->sample_points_buffer->Release();
-            instance->point_normals_buffer->Release();
-            instance->write_sample_points_buffer->Release();
+            instance->payloads_buffer->Release();
+            instance->write_payloads_buffer->Release();
         }
-
-        instance->samples_count = Bluenoise::generate_sample_points(
-            &instance->sample_points_buffer,
-            &instance->point_normals_buffer,
-            &instance->scale_factor,
-
-            &mesh->preprocess,
-            mesh->ib, mesh->ib_offset,
-            mesh->vb,
-            &instance->transform,
-            radius
-        );
-        properties->samples_mean_area = instance->scale_factor*instance->scale_factor * mesh->preprocess.total_surface_area / instance->samples_count;
+        instance->samples_count = mesh->samples_count;
         total_sample_points += instance->samples_count;
 
+        TranslucentProperties instance_properties = g_translucent_properties[instance->translucent_id];
+        instance_properties.samples_mean_area = instance->scale_factor*instance->scale_factor * mesh->preprocess.total_surface_area / instance->samples_count;
+        for (UINT r = 0; r < 4; r++) instance_properties.object_to_world[r] = { instance->transform.m[r][0], instance->transform.m[r][1], instance->transform.m[r][2] };
+        instance_properties.scale                = instance->scale_factor;
+        instance_properties.node_flux_offset     = node_flux_count;
+        instance_properties.grid_payloads_offset = grid_payloads_count;
+        node_flux_count     += mesh->octree.nodes.len;
+        grid_payloads_count += mesh->grid.point_indices.len;
+
         // insert instance properties into upload buffer
         UINT index = instance->translucent_id * g_globals.translucent_instance_stride + instance->instance_id;
-        properties_upload[index] = *properties;
+        properties_upload[index] = instance_properties;
 
         // update translucent_rgen dispatch dimensions
         g_max_translucent_samples_count = max(instance->samples_count, g_max_translucent_samples_count);
         write_translucent_indices[i] = index;
 
-        // prepare to clone sample points and create destination buffer
-        UINT64 size = instance->samples_count*sizeof(SamplePoint);
-        instance->write_sample_points_buffer = create_buffer(size, D3D12_RESOURCE_STATE_COPY_DEST, D3D12_HEAP_TYPE_DEFAULT, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
-        instance->write_sample_points_buffer->SetName(L"write_sample_points");
-
-        *array_push_uninitialized(&pre_copy)  = CD3DX12_RESOURCE_BARRIER::Transition(instance->sample_points_buffer,       D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_SOURCE);
-        *array_push_uninitialized(&post_copy) = CD3DX12_RESOURCE_BARRIER::Transition(instance->sample_points_buffer,       D3D12_RESOURCE_STATE_COPY_SOURCE,      D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
-        *array_push_uninitialized(&post_copy) = CD3DX12_RESOURCE_BARRIER::Transition(instance->write_sample_points_buffer, D3D12_RESOURCE_STATE_COPY_DEST,        D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
-
-        array_push(&copies, { instance->write_sample_points_buffer, instance->sample_points_buffer, size });
+        // payloads start at zero, the write target is copied back after each collection
+        while (zeros.len < instance->samples_count) array_push(&zeros, {});
+        ArrayView<XMFLOAT4> instance_zeros = array_slice(&zeros, 0, instance->samples_count);
+        instance->payloads_buffer       = create_buffer_and_write_contents(cmd_list, instance_zeros, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, Device::push_uninitialized_temp_resource(temp_resources));
+        instance->write_payloads_buffer = create_buffer_and_write_contents(cmd_list, instance_zeros, D3D12_RESOURCE_STATE_UNORDERED_ACCESS,          Device::push_uninitialized_temp_resource(temp_resources));
+        instance->payloads_buffer->SetName(L"translucent_payloads");
+        instance->write_payloads_buffer->SetName(L"write_translucent_payloads");
     }
-
-    // perform sample points clone
-    cmd_list->ResourceBarrier(pre_copy.len,  pre_copy.ptr);
-    for (const auto& copy : copies) cmd_list->CopyBufferRegion(copy._0, 0, copy._1, 0, copy._2);
-    cmd_list->ResourceBarrier(post_copy.len, post_copy.ptr);
-
-    array_free(&pre_copy); array_free(&post_copy); array_free(&copies);
+    array_free(&zeros);
 
     // copy translucent properties from upload buffer to main buffer
     g_translucent_properties_buffer = create_buffer(array_len_in_bytes(&properties_upload), D3D12_RESOURCE_STATE_COPY_DEST);
@@ -630,6 +1383,44 @@ UINT generate_translucent_samples(ID3D12GraphicsCommandList4* cmd_list, float ra
     array_unmap_resource(&properties_upload);
     Device::push_temp_resource(properties_upload.resource, temp_resources);
 
+    // upload octrees
+    ID3D12Resource** octree_buffers[] = {
+        &g_translucent_nodes_buffer, &g_translucent_point_indices_buffer, &g_translucent_node_flux_buffer,
+        &g_translucent_grid_cells_buffer, &g_translucent_grid_point_indices_buffer, &g_translucent_grid_positions_buffer, &g_translucent_grid_payloads_buffer,
+        &g_translucent_photon_flux_buffer,
+    };
+    for (auto buffer : octree_buffers) {
+        if (*buffer) (*buffer)->Release();
+        *buffer = NULL;
+    }
+    if (nodes.len) {
+        g_translucent_nodes_buffer         = create_buffer_and_write_contents(cmd_list, nodes,         D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, Device::push_uninitialized_temp_resource(temp_resources));
+        g_translucent_point_indices_buffer = create_buffer_and_write_contents(cmd_list, point_indices, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, Device::push_uninitialized_temp_resource(temp_resources));
+        g_translucent_node_flux_buffer     = create_buffer(node_flux_count*sizeof(XMFLOAT3), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_HEAP_TYPE_DEFAULT, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+        SET_NAME(g_translucent_nodes_buffer);
+        SET_NAME(g_translucent_point_indices_buffer);
+        SET_NAME(g_translucent_node_flux_buffer);
+    }
+    if (grid_cells.len) {
+        g_translucent_grid_cells_buffer         = create_buffer_and_write_contents(cmd_list, grid_cells,         D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, Device::push_uninitialized_temp_resource(temp_resources));
+        g_translucent_grid_point_indices_buffer = create_buffer_and_write_contents(cmd_list, grid_point_indices, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, Device::push_uninitialized_temp_resource(temp_resources));
+        g_translucent_grid_positions_buffer     = create_buffer_and_write_contents(cmd_list, grid_positions,     D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, Device::push_uninitialized_temp_resource(temp_resources));
+        g_translucent_grid_payloads_buffer      = create_buffer(grid_payloads_count*payload_size, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_HEAP_TYPE_DEFAULT, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+        g_translucent_photon_flux_buffer        = create_buffer(grid_payloads_count*sizeof(XMFLOAT3), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_HEAP_TYPE_DEFAULT, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS); // committed, so zeroed
+        SET_NAME(g_translucent_grid_cells_buffer);
+        SET_NAME(g_translucent_grid_point_indices_buffer);
+        SET_NAME(g_translucent_grid_positions_buffer);
+        SET_NAME(g_translucent_grid_payloads_buffer);
+        SET_NAME(g_translucent_photon_flux_buffer);
+    }
+    g_translucent_refit_pending = true;
+
+    array_free(&nodes);
+    array_free(&point_indices);
+    array_free(&grid_cells);
+    array_free(&grid_point_indices);
+    array_free(&grid_positions);
+
     // copy translucent indices
     if (g_write_translucent_indices_buffer && g_write_translucent_indices_buffer->GetDesc().Width < array_len_in_bytes(&write_translucent_indices)) {
         g_write_translucent_indices_buffer->Release();
@@ -649,21 +1440,342 @@ UINT generate_translucent_samples(ID3D12GraphicsCommandList4* cmd_list, float ra
     return total_sample_points;
 }
 
-void dispatch_rays(ID3D12GraphicsCommandList4* cmd_list) {
+inline void set_ray_generation_shader_record(D3D12_DISPATCH_RAYS_DESC* dispatch_rays, ID3D12Resource* shader_record) {
+    dispatch_rays->RayGenerationShaderRecord.StartAddress = shader_record->GetGPUVirtualAddress();
+    dispatch_rays->RayGenerationShaderRecord.SizeInBytes  = shader_record->GetDesc().Width;
+}
+
+// copy the counts of queues [first, first + count) into the widths of their dispatches, and clear them for the next pushes
+void take_path_queues(ID3D12GraphicsCommandList4* cmd_list, UINT first, UINT count) {
+    D3D12_RESOURCE_BARRIER barriers[] = {
+        CD3DX12_RESOURCE_BARRIER::Transition(g_path_queue_counts, D3D12_RESOURCE_STATE_UNORDERED_ACCESS,  D3D12_RESOURCE_STATE_COPY_SOURCE),
+        CD3DX12_RESOURCE_BARRIER::Transition(g_path_dispatches,   D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT, D3D12_RESOURCE_STATE_COPY_DEST),
+    };
+    cmd_list->ResourceBarrier(_countof(barriers), barriers);
+
+    for (UINT queue = first; queue < first + count; queue++) {
+        UINT64 width_offset = queue*sizeof(D3D12_DISPATCH_RAYS_DESC) + offsetof(D3D12_DISPATCH_RAYS_DESC, Width);
+        cmd_list->CopyBufferRegion(g_path_dispatches, width_offset, g_path_queue_counts, queue*sizeof(UINT32), sizeof(UINT32));
+    }
+
+    barriers[0] = CD3DX12_RESOURCE_BARRIER::Transition(g_path_queue_counts, D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_COPY_DEST);
+    barriers[1] = CD3DX12_RESOURCE_BARRIER::Transition(g_path_dispatches,   D3D12_RESOURCE_STATE_COPY_DEST,   D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT);
+    cmd_list->ResourceBarrier(_countof(barriers), barriers);
+
+    cmd_list->CopyBufferRegion(g_path_queue_counts, first*sizeof(UINT32), g_path_queue_counts_reset, 0, count*sizeof(UINT32));
+    cmd_list->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(g_path_queue_counts, D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_UNORDERED_ACCESS));
+}
+
+void reset_counter(ID3D12GraphicsCommandList4* cmd_list, ID3D12Resource* counter) {
+    UINT64 size = counter->GetDesc().Width;
+    cmd_list->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(counter, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_DEST));
+    cmd_list->CopyBufferRegion(counter, 0, g_path_queue_counts_reset, 0, size);
+    cmd_list->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(counter, D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_UNORDERED_ACCESS));
+}
+
+void copy_to_readback(ID3D12GraphicsCommandList4* cmd_list, ID3D12Resource* readback, ID3D12Resource* src) {
+    cmd_list->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(src, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_SOURCE));
+    cmd_list->CopyBufferRegion(readback, 0, src, 0, src->GetDesc().Width);
+    cmd_list->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(src, D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS));
+}
+
+// train the guiding distribution when the previous frame completed an iteration, and set this frame's recording
+// the records of a frame are read back after its command list has finished executing
+void update_guiding(ID3D12GraphicsCommandList4* cmd_list) {
+    // wavefront paths record no radiance to train from
+    bool enabled = g_enable_guiding && !(g_enable_wavefront && !g_enable_bidirectional);
+
+    if (!enabled || g_reset_guiding) {
+        Guiding::reset(&g_guiding_tree);
+        g_guiding_report.len   = 0;
+        g_guiding_frames       = 0;
+        g_guiding_variance_sum = 0;
+
+        if (g_guiding_spatial_nodes_buffer)     g_guiding_spatial_nodes_buffer->Release();
+        if (g_guiding_directional_nodes_buffer) g_guiding_directional_nodes_buffer->Release();
+        g_guiding_spatial_nodes_buffer     = NULL;
+        g_guiding_directional_nodes_buffer = NULL;
+
+        g_globals.guiding_sampling           = 0;
+        g_globals.guiding_record_probability = 0;
+
+        reset_counter(cmd_list, g_guiding_records_count);
+        g_reset_guiding = false;
+    }
+    if (!enabled) return;
+
+    UINT iteration = g_guiding_report.len;
+    if (iteration >= GUIDING_TRAINING_ITERATIONS) return;
+
+    if (g_guiding_frames > 0) g_guiding_variance_sum += g_pixel_variance; // of the previous frame
+
+    if (g_guiding_frames == 1u << iteration) {
+        UINT32 records_count = 0;
+        copy_from_readback_buffer(array_of(&records_count), g_guiding_records_count_readback);
+        records_count = min(records_count, GUIDING_RECORDS_CAPACITY);
+
+        Array<GuidingRecord> records = array_init<GuidingRecord>(records_count);
+        records.len = records_count;
+        copy_from_readback_buffer(records, g_guiding_records_readback);
+        Guiding::train(&g_guiding_tree, records);
+        array_free(&records);
+
+        GuidingIteration report = {};
+        report.frames                  = g_guiding_frames;
+        report.records_count           = records_count;
+        report.spatial_leaves_count    = g_guiding_tree.spatial_leaves_count;
+        report.directional_nodes_count = g_guiding_tree.directional_nodes.len;
+        report.pixel_variance          = g_guiding_variance_sum / g_guiding_frames;
+        array_push(&g_guiding_report, report);
+
+        if (g_guiding_spatial_nodes_buffer)     g_guiding_spatial_nodes_buffer->Release();
+        if (g_guiding_directional_nodes_buffer) g_guiding_directional_nodes_buffer->Release();
+        g_guiding_spatial_nodes_buffer     = create_buffer_and_write_contents(cmd_list, g_guiding_tree.spatial_nodes,     D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, NULL);
+        g_guiding_directional_nodes_buffer = create_buffer_and_write_contents(cmd_list, g_guiding_tree.directional_nodes, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, NULL);
+        SET_NAME(g_guiding_spatial_nodes_buffer);
+        SET_NAME(g_guiding_directional_nodes_buffer);
+
+        g_globals.guiding_aabb_min = g_guiding_tree.aabb_min;
+        g_globals.guiding_aabb_max = g_guiding_tree.aabb_max;
+        g_globals.guiding_sampling = 1;
+
+        reset_counter(cmd_list, g_guiding_records_count);
+        g_guiding_frames       = 0;
+        g_guiding_variance_sum = 0;
+        iteration += 1;
+    }
+
+    // spread the records of the iteration over its frames, assuming about two recorded vertices per path
+    if (iteration < GUIDING_TRAINING_ITERATIONS) {
+        double paths_count = (double) g_width*g_height*g_globals.samples_per_pixel * (1u << iteration);
+        g_globals.guiding_record_probability = (float) min(1.0, GUIDING_RECORDS_CAPACITY / (2*paths_count));
+    } else {
+        g_globals.guiding_record_probability = 0;
+    }
+}
+
+// while interacting, trace blocks of pixels sized for the frame to fit the budget, from the time of the previous frame
+// otherwise, refine a new image through g_refinement_levels before tracing every pixel
+void update_render_scale() {
+    UINT scale  = 1;
+    UINT offset = 0;
+    if (g_enable_dynamic_resolution && g_interacting) {
+        double milliseconds_per_pixel = g_render_milliseconds / ((double) g_render_width*g_render_height);
+        if (milliseconds_per_pixel > 0) {
+            double pixels_count = g_interaction_budget_milliseconds / milliseconds_per_pixel;
+            scale = (UINT) clamp(ceilf(sqrtf((float) (g_width*g_height / pixels_count))), 1, RENDER_SCALE_MAX);
+        } else {
+            scale = max(g_globals.render_scale, 1u);
+        }
+    } else if (g_enable_progressive_refinement && !g_reproject_accumulator && g_globals.accumulator_count < _countof(g_refinement_levels)) {
+        scale  = g_refinement_levels[g_globals.accumulator_count].scale;
+        offset = g_refinement_levels[g_globals.accumulator_count].offset;
+    }
+
+    g_globals.render_scale  = scale;
+    g_globals.render_offset = offset;
+    g_render_width  = (g_width  + scale - 1) / scale;
+    g_render_height = (g_height + scale - 1) / scale;
+}
+
+// radius beyond which the bssrdf is below g_translucent_cutoff_tolerance of its value at 0, in every channel
+// the tabulated profile is clamped to the border beyond translucent_bssrdf_scale
+// without a cutoff, probe rays still sample disks up to where the profile falls below TRANSLUCENT_DIPOLE_LUT_TOLERANCE
+void update_translucent_cutoff() {
+    XMFLOAT3 s = g_globals.translucent_scattering, a = g_globals.translucent_absorption;
+    float    n = g_globals.translucent_refractive_index;
+
+    float radius = 0;
+    if (g_translucent_cutoff_tolerance > 0) {
+        if (g_globals.translucent_bssrdf_scale) {
+            radius = g_globals.translucent_bssrdf_scale;
+        } else {
+            radius = Translucent::dipole_radius(s, a, n, g_translucent_cutoff_tolerance);
+        }
+    }
+    g_globals.translucent_cutoff_radius = radius;
+
+    if (!g_globals.translucent_probes) return;
+    if (radius == 0) {
+        radius = g_globals.translucent_bssrdf_scale ? g_globals.translucent_bssrdf_scale : Translucent::dipole_radius(s, a, n, TRANSLUCENT_DIPOLE_LUT_TOLERANCE);
+    }
+    g_globals.translucent_probe_radius = radius;
+}
+
+// tabulate the dipole profile for the current scattering, absorption and refractive index
+// the table ends at the radius where the profile falls below TRANSLUCENT_DIPOLE_LUT_TOLERANCE of its peak, as in update_translucent_cutoff
+void update_dipole_lut(ID3D12GraphicsCommandList4* cmd_list) {
+    XMFLOAT3 s = g_globals.translucent_scattering, a = g_globals.translucent_absorption;
+    float    n = g_globals.translucent_refractive_index;
+
+    bool changed = !Prelude::equals(&s, &g_dipole_lut_scattering) || !Prelude::equals(&a, &g_dipole_lut_absorption) || n != g_dipole_lut_refractive_index;
+    if (changed) {
+        g_dipole_lut_scattering       = s;
+        g_dipole_lut_absorption       = a;
+        g_dipole_lut_refractive_index = n;
+
+        g_dipole_lut_radius = Translucent::dipole_radius(s, a, n, TRANSLUCENT_DIPOLE_LUT_TOLERANCE);
+        g_dipole_lut_error  = 0;
+
+        if (g_dipole_lut_radius > 0) {
+            static XMFLOAT3 table[TRANSLUCENT_DIPOLE_LUT_SIZE];
+            g_dipole_lut_error = Translucent::tabulate_dipole(VLA_VIEW(table), s, a, n, g_dipole_lut_radius);
+
+            cmd_list->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(g_dipole_lut, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_COPY_DEST));
+            copy_to_upload_buffer(g_dipole_lut_upload, VLA_VIEW(table));
+            cmd_list->CopyResource(g_dipole_lut, g_dipole_lut_upload);
+            cmd_list->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(g_dipole_lut, D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE));
+        }
+    }
+    g_globals.translucent_dipole_lut_radius = g_enable_dipole_lut ? g_dipole_lut_radius : 0;
+}
+
+// the requested AOVs which have been allocated, by the next update_resolution after requesting them
+UINT allocated_aovs() {
+    UINT aovs = 0;
+    if ((g_aovs & AOV_NORMAL_DEPTH) && g_first_hits)       aovs |= AOV_NORMAL_DEPTH;
+    if ((g_aovs & AOV_ALBEDO)       && g_first_hit_albedo) aovs |= AOV_ALBEDO;
+    if ((g_aovs & AOV_IDS)          && g_first_hit_ids)    aovs |= AOV_IDS;
+    return aovs;
+}
+
+// when the camera moved, copy the per-pixel state of the previous view for the ray generation shaders to warp
+void update_reprojection(ID3D12GraphicsCommandList4* cmd_list) {
+    bool enabled = g_enable_reprojection && g_history_accumulator; // allocated by the next update_resolution after enabling
+
+    g_globals.reprojection      = enabled;
+    g_globals.aovs              = allocated_aovs();
+    g_globals.reproject_history = enabled && g_reproject_accumulator && g_globals.accumulator_count != 0;
+    g_reproject_accumulator     = false;
+
+    if (g_globals.reproject_history) {
+        XMStoreFloat4x4A(&g_globals.previous_world_to_camera, XMMatrixInverse(NULL, XMLoadFloat4x4A(&g_previous_camera_to_world)));
+        g_globals.previous_camera_focal_length = g_previous_camera_focal_length;
+
+        Pair<ID3D12Resource*, ID3D12Resource*> copies[] = { // dest, src
+            { g_history_accumulator, g_sample_accumulator },
+            { g_history_first_hits,  g_first_hits         },
+            { g_history_counts,      g_sample_counts      },
+        };
+
+        D3D12_RESOURCE_BARRIER pre_copy_barriers [2*_countof(copies)];
+        D3D12_RESOURCE_BARRIER post_copy_barriers[2*_countof(copies)];
+        for (UINT i = 0; i < _countof(copies); i++) {
+            pre_copy_barriers [2*i + 0] = CD3DX12_RESOURCE_BARRIER::Transition(copies[i]._0, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_DEST);
+            pre_copy_barriers [2*i + 1] = CD3DX12_RESOURCE_BARRIER::Transition(copies[i]._1, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_SOURCE);
+            post_copy_barriers[2*i + 0] = CD3DX12_RESOURCE_BARRIER::Transition(copies[i]._0, D3D12_RESOURCE_STATE_COPY_DEST,        D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+            post_copy_barriers[2*i + 1] = CD3DX12_RESOURCE_BARRIER::Transition(copies[i]._1, D3D12_RESOURCE_STATE_COPY_SOURCE,      D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+        }
+
+        cmd_list->ResourceBarrier(_countof(pre_copy_barriers), pre_copy_barriers);
+        for (auto& copy : copies) cmd_list->CopyResource(copy._0, copy._1);
+        cmd_list->ResourceBarrier(_countof(post_copy_barriers), post_copy_barriers);
+    }
+
+    g_previous_camera_to_world     = g_globals.camera_to_world;
+    g_previous_camera_focal_length = g_globals.camera_focal_length;
+}
+
+void dispatch_wavefront(ID3D12GraphicsCommandList4* cmd_list, D3D12_DISPATCH_RAYS_DESC dispatch_rays) {
+    WavefrontConstants wf = {};
+    wf.paths_count = g_render_width*g_render_height;
+
+    // trace and shade dispatches with the frame's shader tables, whose widths are copied from the queue counts
+    D3D12_DISPATCH_RAYS_DESC dispatches[PATH_QUEUES_COUNT];
+    for (UINT queue = 0; queue < PATH_QUEUES_COUNT; queue++) {
+        dispatches[queue] = dispatch_rays;
+        set_ray_generation_shader_record(&dispatches[queue], queue == PATH_TRACE_QUEUE ? g_wavefront_trace_rgen_shader_record : g_wavefront_shade_rgen_shader_record);
+        dispatches[queue].Width  = 0;
+        dispatches[queue].Height = 1;
+        dispatches[queue].Depth  = 1;
+    }
+    cmd_list->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(g_path_dispatches, D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT, D3D12_RESOURCE_STATE_COPY_DEST));
+    copy_to_upload_buffer(g_path_dispatches_upload, VLA_VIEW(dispatches));
+    cmd_list->CopyResource(g_path_dispatches, g_path_dispatches_upload);
+    cmd_list->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(g_path_dispatches, D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT));
+
+    for (wf.sample_index = 0; wf.sample_index < g_globals.samples_per_pixel; wf.sample_index++) {
+        // generate camera rays into the trace queue
+        reset_counter(cmd_list, g_path_queue_counts);
+        cmd_list->SetComputeRoot32BitConstants(WAVEFRONT_CONSTANTS_ROOT_INDEX, sizeof(wf)/4, &wf, 0);
+
+        set_ray_generation_shader_record(&dispatch_rays, g_wavefront_generate_rgen_shader_record);
+        dispatch_rays.Width  = g_render_width;
+        dispatch_rays.Height = g_render_height;
+        cmd_list->DispatchRays(&dispatch_rays);
+        cmd_list->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::UAV(NULL));
+
+        // extend all live paths by one segment per bounce
+        for (wf.bounce_index = 0; wf.bounce_index <= g_globals.bounces_per_sample; wf.bounce_index++) {
+            // bin the paths of the trace queue by the shader of their next hit
+            take_path_queues(cmd_list, PATH_TRACE_QUEUE, 1);
+            wf.shader = 0;
+            cmd_list->SetComputeRoot32BitConstants(WAVEFRONT_CONSTANTS_ROOT_INDEX, sizeof(wf)/4, &wf, 0);
+
+            cmd_list->ExecuteIndirect(g_dispatch_rays_signature, 1, g_path_dispatches, PATH_TRACE_QUEUE*sizeof(D3D12_DISPATCH_RAYS_DESC), NULL, 0);
+            cmd_list->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::UAV(NULL));
+
+            // shade each bin, pushing the surviving paths back into the trace queue
+            take_path_queues(cmd_list, 0, PATH_TRACE_QUEUE);
+            for (wf.shader = 0; wf.shader < PATH_TRACE_QUEUE; wf.shader++) {
+                cmd_list->SetComputeRoot32BitConstants(WAVEFRONT_CONSTANTS_ROOT_INDEX, sizeof(wf)/4, &wf, 0);
+                cmd_list->ExecuteIndirect(g_dispatch_rays_signature, 1, g_path_dispatches, wf.shader*sizeof(D3D12_DISPATCH_RAYS_DESC), NULL, 0);
+            }
+            cmd_list->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::UAV(NULL));
+        }
+        wf.bounce_index = 0;
+        wf.shader       = 0;
+    }
+
+    // resolve path radiance into the accumulator
+    cmd_list->SetComputeRoot32BitConstants(WAVEFRONT_CONSTANTS_ROOT_INDEX, sizeof(wf)/4, &wf, 0);
+
+    set_ray_generation_shader_record(&dispatch_rays, g_wavefront_resolve_rgen_shader_record);
+    dispatch_rays.Width  = g_render_width;
+    dispatch_rays.Height = g_render_height;
+    cmd_list->DispatchRays(&dispatch_rays);
+}
+
+void set_pipeline_state(ID3D12GraphicsCommandList4* cmd_list) {
+    cmd_list->SetComputeRootSignature(Raytracing::g_global_root_signature);
+    RootArgument::set_on_command_list(cmd_list, g_root_args);
+    cmd_list->SetPipelineState1(Raytracing::g_pso);
+
+    WavefrontConstants wf = {};
+    cmd_list->SetComputeRoot32BitConstants(WAVEFRONT_CONSTANTS_ROOT_INDEX, sizeof(wf)/4, &wf, 0);
+
+    TileConstants tile = {};
+    cmd_list->SetComputeRoot32BitConstants(TILE_CONSTANTS_ROOT_INDEX, sizeof(tile)/4, &tile, 0);
+
+    TranslucentRefitConstants refit = {};
+    cmd_list->SetComputeRoot32BitConstants(TRANSLUCENT_REFIT_ROOT_INDEX, sizeof(refit)/4, &refit, 0);
+
+    if (g_globals.guiding_sampling) {
+        cmd_list->SetComputeRootShaderResourceView(GUIDING_SPATIAL_NODES_ROOT_INDEX,     g_guiding_spatial_nodes_buffer->GetGPUVirtualAddress());
+        cmd_list->SetComputeRootShaderResourceView(GUIDING_DIRECTIONAL_NODES_ROOT_INDEX, g_guiding_directional_nodes_buffer->GetGPUVirtualAddress());
+    }
+}
+
+void dispatch_rays(ID3D12GraphicsCommandList4* cmd_list, FlushFrame flush) {
     float translucent_bssrdf_fudge = g_globals.translucent_bssrdf_fudge;
     if (!g_enable_subsurface_scattering) {
         // HACK: this variable is set to zero to disable translucent bssrdf: set value to zero and resore at end of scope
         g_globals.translucent_bssrdf_fudge = 0;
     }
+    cmd_list->EndQuery(g_timestamp_query_heap, D3D12_QUERY_TYPE_TIMESTAMP, 0);
+
+    update_render_scale();
+    update_translucent_cutoff();
+    update_dipole_lut(cmd_list);
+    update_guiding(cmd_list);
+    update_reprojection(cmd_list);
 
     cmd_list->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(g_globals_buffer, D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_COPY_DEST));
     copy_to_upload_buffer(g_globals_upload, array_of(&g_globals));
     cmd_list->CopyResource(g_globals_buffer, g_globals_upload);
     cmd_list->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(g_globals_buffer, D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE));
 
-    cmd_list->SetComputeRootSignature(Raytracing::g_global_root_signature);
-    RootArgument::set_on_command_list(cmd_list, g_root_args);
-    cmd_list->SetPipelineState1(Raytracing::g_pso);
+    set_pipeline_state(cmd_list);
 
     D3D12_DISPATCH_RAYS_DESC dispatch_rays = {};
     dispatch_rays.HitGroupTable.StartAddress  = g_hit_group_shader_table->GetGPUVirtualAddress();
@@ -674,26 +1786,61 @@ void dispatch_rays(ID3D12GraphicsCommandList4* cmd_list) {
     dispatch_rays.MissShaderTable.SizeInBytes   = g_miss_shader_table->GetDesc().Width;
     dispatch_rays.MissShaderTable.StrideInBytes = D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES;
 
-    if (g_enable_translucent_sample_collection) {
-        // dispatch translucent samples
-        dispatch_rays.RayGenerationShaderRecord.StartAddress = g_translucent_rgen_shader_record->GetGPUVirtualAddress();
-        dispatch_rays.RayGenerationShaderRecord.SizeInBytes  = g_translucent_rgen_shader_record->GetDesc().Width;
+    reset_counter(cmd_list, g_frame_statistics);
 
-        dispatch_rays.Width  = g_max_translucent_samples_count;
-        dispatch_rays.Height = g_translucent_instances.len;
+    if (g_clear_radiance_cache) {
+        set_ray_generation_shader_record(&dispatch_rays, g_radiance_cache_clear_rgen_shader_record);
+        dispatch_rays.Width  = RADIANCE_CACHE_CAPACITY;
+        dispatch_rays.Height = 1;
+        dispatch_rays.Depth  = 1;
+        cmd_list->DispatchRays(&dispatch_rays);
+
+        D3D12_RESOURCE_BARRIER barriers[] = {
+            CD3DX12_RESOURCE_BARRIER::UAV(g_radiance_cache_keys),
+            CD3DX12_RESOURCE_BARRIER::UAV(g_radiance_cache_values),
+        };
+        cmd_list->ResourceBarrier(_countof(barriers), barriers);
+        g_clear_radiance_cache = false;
+    }
+
+    // probe rays sample the bssrdf without the sample points
+    bool collect_translucent_samples = g_enable_translucent_sample_collection && !g_globals.translucent_probes;
+
+    if (collect_translucent_samples && g_enable_translucent_photons && g_translucent_photon_flux_buffer) {
+        // shoot photons, then resolve their deposits into one update of every sample point
+        set_ray_generation_shader_record(&dispatch_rays, g_translucent_photon_rgen_shader_record);
+
+        dispatch_rays.Width  = max(g_translucent_photons_count, 1u);
+        dispatch_rays.Height = 1;
         dispatch_rays.Depth  = 1;
 
         cmd_list->DispatchRays(&dispatch_rays);
-    }    // dispatch render
-    dispatch_rays.RayGenerationShaderRecord.StartAddress = g_camera_rgen_shader_record->GetGPUVirtualAddress();
-    dispatch_rays.RayGenerationShaderRecord.SizeInBytes  = g_camera_rgen_shader_record->GetDesc().Width;
+        cmd_list->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::UAV(g_translucent_photon_flux_buffer));
 
-    dispatch_rays.Width  = g_width;
-    dispatch_rays.Height = g_height;
-    dispatch_rays.Depth  = 1;
+        set_ray_generation_shader_record(&dispatch_rays, g_translucent_photon_resolve_rgen_shader_record);
+        g_translucent_update_window = g_max_translucent_samples_count;
 
-    cmd_list->DispatchRays(&dispatch_rays);
+        dispatch_rays.Width  = g_translucent_update_window;
+        dispatch_rays.Height = g_translucent_instances.len;
+
+        cmd_list->DispatchRays(&dispatch_rays);
+    } else if (collect_translucent_samples) {
+        // the first frame after a reset restarts the mean of every point
+        g_translucent_update_window = g_max_translucent_samples_count;
+        if (g_translucent_ray_budget && g_globals.translucent_accumulator_count != 0) {
+            UINT paths_per_point = g_globals.samples_per_pixel * max((UINT) g_translucent_instances.len, 1u);
+            g_translucent_update_window = min(g_translucent_update_window, max(g_translucent_ray_budget / paths_per_point, 1u));
+        }
+
+        // dispatch translucent samples
+        set_ray_generation_shader_record(&dispatch_rays, g_translucent_rgen_shader_record);
+
+        dispatch_rays.Width  = g_translucent_update_window;
+        dispatch_rays.Height = g_translucent_instances.len;
+        dispatch_rays.Depth  = 1;
 
+        cmd_list->DispatchRays(&dispatch_rays);
+    }
 
     // batch resource barriers
     static Array<D3D12_RESOURCE_BARRIER> pre_copy_barriers = {};
@@ -702,47 +1849,119 @@ void dispatch_rays(ID3D12GraphicsCommandList4* cmd_list) {
     post_copy_barriers.len = 0;
 
     // memory barrier translucent buffers
-    if (g_enable_translucent_sample_collection) {
+    if (collect_translucent_samples) {
         for (auto& instance : g_translucent_instances) {
-            *array_push_uninitialized(&pre_copy_barriers)  = CD3DX12_RESOURCE_BARRIER::UAV(instance.write_sample_points_buffer);
+            *array_push_uninitialized(&pre_copy_barriers)  = CD3DX12_RESOURCE_BARRIER::UAV(instance.write_payloads_buffer);
 
-            *array_push_uninitialized(&pre_copy_barriers)  = CD3DX12_RESOURCE_BARRIER::Transition(instance.write_sample_points_buffer, D3D12_RESOURCE_STATE_UNORDERED_ACCESS,          D3D12_RESOURCE_STATE_COPY_SOURCE);
-            *array_push_uninitialized(&pre_copy_barriers)  = CD3DX12_RESOURCE_BARRIER::Transition(instance.sample_points_buffer,       D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_COPY_DEST);
+            *array_push_uninitialized(&pre_copy_barriers)  = CD3DX12_RESOURCE_BARRIER::Transition(instance.write_payloads_buffer, D3D12_RESOURCE_STATE_UNORDERED_ACCESS,          D3D12_RESOURCE_STATE_COPY_SOURCE);
+            *array_push_uninitialized(&pre_copy_barriers)  = CD3DX12_RESOURCE_BARRIER::Transition(instance.payloads_buffer,       D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_COPY_DEST);
 
-            *array_push_uninitialized(&post_copy_barriers) = CD3DX12_RESOURCE_BARRIER::Transition(instance.write_sample_points_buffer, D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
-            *array_push_uninitialized(&post_copy_barriers) = CD3DX12_RESOURCE_BARRIER::Transition(instance.sample_points_buffer,       D3D12_RESOURCE_STATE_COPY_DEST,   D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+            *array_push_uninitialized(&post_copy_barriers) = CD3DX12_RESOURCE_BARRIER::Transition(instance.write_payloads_buffer, D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+            *array_push_uninitialized(&post_copy_barriers) = CD3DX12_RESOURCE_BARRIER::Transition(instance.payloads_buffer,       D3D12_RESOURCE_STATE_COPY_DEST,   D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
         }
     }
-    // memory barrier render targets
-    *array_push_uninitialized(&post_copy_barriers) = CD3DX12_RESOURCE_BARRIER::UAV(g_render_target);
-    *array_push_uninitialized(&post_copy_barriers) = CD3DX12_RESOURCE_BARRIER::UAV(g_sample_accumulator);
 
     // insert first set of resource barriers
     if (pre_copy_barriers.len)  cmd_list->ResourceBarrier(pre_copy_barriers.len,  pre_copy_barriers.ptr);
 
     // perform translucent buffer copies
-    if (g_enable_translucent_sample_collection) {
+    if (collect_translucent_samples) {
         for (auto& instance : g_translucent_instances) {
-            cmd_list->CopyBufferRegion(instance.sample_points_buffer, 0, instance.write_sample_points_buffer, 0, instance.samples_count*sizeof(SamplePoint));
+            cmd_list->CopyBufferRegion(instance.payloads_buffer, 0, instance.write_payloads_buffer, 0, instance.samples_count*sizeof(XMFLOAT4));
         }
     }
 
     // insert second set of resource barriers
     if (post_copy_barriers.len) cmd_list->ResourceBarrier(post_copy_barriers.len, post_copy_barriers.ptr);
 
+    // update the gather structures from the collected samples
+    if ((collect_translucent_samples || g_translucent_refit_pending) && g_translucent_node_flux_buffer) {
+        dispatch_rays.Height = g_translucent_instances.len;
+        dispatch_rays.Depth  = 1;
+
+        // permute the payloads into grid order
+        set_ray_generation_shader_record(&dispatch_rays, g_translucent_permute_rgen_shader_record);
+        dispatch_rays.Width = g_max_translucent_samples_count;
+        cmd_list->DispatchRays(&dispatch_rays);
+        cmd_list->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::UAV(g_translucent_grid_payloads_buffer));
+
+        // refit the octrees' flux, bottom-up as each node sums its children
+        set_ray_generation_shader_record(&dispatch_rays, g_translucent_refit_rgen_shader_record);
+
+        TranslucentRefitConstants refit = {};
+        for (refit.level = g_translucent_levels_count; refit.level-- > 0;) {
+            cmd_list->SetComputeRoot32BitConstants(TRANSLUCENT_REFIT_ROOT_INDEX, sizeof(refit)/4, &refit, 0);
+
+            dispatch_rays.Width = g_translucent_level_widths[refit.level];
+            cmd_list->DispatchRays(&dispatch_rays);
+            cmd_list->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::UAV(g_translucent_node_flux_buffer));
+        }
+        g_translucent_refit_pending = false;
+    }
+
     // dispatch render
-    dispatch_rays.RayGenerationShaderRecord.StartAddress = g_camera_rgen_shader_record->GetGPUVirtualAddress();
-    dispatch_rays.RayGenerationShaderRecord.SizeInBytes  = g_camera_rgen_shader_record->GetDesc().Width;
+    bool cancelled = false;
+    dispatch_rays.Depth = 1;
+    if (g_enable_wavefront && !g_enable_bidirectional) {
+        dispatch_wavefront(cmd_list, dispatch_rays);
+    } else {
+        if (g_enable_bidirectional) set_ray_generation_shader_record(&dispatch_rays, g_bdpt_rgen_shader_record);
+        else                        set_ray_generation_shader_record(&dispatch_rays, g_camera_rgen_shader_record);
+
+        // between tiles the commands so far are submitted, and the rest of a stale frame is skipped
+        // tiles cover disjoint pixels, which keep their own sample counts, so a partial frame leaves a consistent accumulator
+        // unless it reprojected, see below
+        UINT tiles         = flush ? max(g_frame_tiles, 1u) : 1;
+        UINT rows_per_tile = (g_render_height + tiles - 1) / tiles;
+
+        TileConstants tile = {};
+        for (tile.first_row = 0; tile.first_row < g_render_height; tile.first_row += rows_per_tile) {
+            if (tile.first_row > 0) {
+                if (flush(cmd_list)) {
+                    cancelled = true;
+                    g_cancelled_frames_count += 1;
+                    break;
+                }
+                set_pipeline_state(cmd_list);
+            }
+            cmd_list->SetComputeRoot32BitConstants(TILE_CONSTANTS_ROOT_INDEX, sizeof(tile)/4, &tile, 0);
 
-    dispatch_rays.Width  = g_width;
-    dispatch_rays.Height = g_height;
-    dispatch_rays.Depth  = 1;
+            dispatch_rays.Width  = g_render_width;
+            dispatch_rays.Height = min(rows_per_tile, g_render_height - tile.first_row);
 
-    cmd_list->DispatchRays(&dispatch_rays);
+            cmd_list->DispatchRays(&dispatch_rays);
+        }
+    }
+
+    // memory barrier render targets
+    D3D12_RESOURCE_BARRIER render_barriers[] = {
+        CD3DX12_RESOURCE_BARRIER::UAV(g_render_target),
+        CD3DX12_RESOURCE_BARRIER::UAV(g_sample_accumulator),
+        CD3DX12_RESOURCE_BARRIER::UAV(g_sample_counts),
+    };
+    cmd_list->ResourceBarrier(_countof(render_barriers), render_barriers);
+
+    cmd_list->EndQuery(g_timestamp_query_heap, D3D12_QUERY_TYPE_TIMESTAMP, 1);
+    cmd_list->ResolveQueryData(g_timestamp_query_heap, D3D12_QUERY_TYPE_TIMESTAMP, 0, 2, g_timestamp_readback, 0);
+
+    copy_to_readback(cmd_list, g_frame_statistics_readback, g_frame_statistics);
+
+    // read back the records once the iteration's last frame has been rendered
+    if (g_globals.guiding_record_probability > 0) {
+        g_guiding_frames += 1;
+        if (g_guiding_frames == 1u << g_guiding_report.len) {
+            copy_to_readback(cmd_list, g_guiding_records_readback,       g_guiding_records);
+            copy_to_readback(cmd_list, g_guiding_records_count_readback, g_guiding_records_count);
+        }
+    }
 
     // update globals
-    g_globals.accumulator_count             += 1;
-    g_globals.translucent_accumulator_count += g_enable_translucent_sample_collection;
+    g_globals.accumulator_count             += !cancelled; // a cancelled frame is traced again at the same level of refinement
+    // the skipped tiles of a cancelled reprojecting frame are left in the previous view, which the updated previous camera
+    // no longer describes: restart the image rather than warp them from the wrong view
+    if (cancelled && g_globals.reproject_history) g_globals.accumulator_count = 0;
+    g_globals.translucent_accumulator_count += collect_translucent_samples;
+    g_globals.translucent_update_offset     += collect_translucent_samples ? g_translucent_update_window : 0;
     g_globals.translucent_bssrdf_fudge = translucent_bssrdf_fudge; // HACK: restoring previous hack
 }
 
@@ -2,6 +2,7 @@
 #include "prelude.h"
 
 #include "device.h"
+#include "guiding.h"
 
 __declspec(align(32)) struct ShaderIdentifier {
     unsigned char bytes[D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES];
@@ -16,14 +17,6 @@ __declspec(align(32)) struct ShaderRecord {
     D3D12_GPU_VIRTUAL_ADDRESS   indices;
 };
 
-enum Shader {
-    Lambert = 0,
-    Light,
-    Translucent,
-
-    Count,
-};
-
 struct Material {
     Shader   shader;
     XMFLOAT3 color;
@@ -42,6 +35,7 @@ struct Blas {
 
     UINT shader_table_index;
     UINT translucent_ids_index, translucent_ids_count; // used to duplicate sample points if necessary
+    UINT emitters_index, emitters_count;               // object-space emitter triangles, instanced into the emitter table
 };
 
 struct BlasInstance {
@@ -62,8 +56,52 @@ extern RaytracingGlobals g_globals;
 
 extern bool g_enable_translucent_sample_collection;
 extern bool g_enable_subsurface_scattering;
+extern bool g_morton_order_sample_points; // on the next generation
+extern bool g_compact_sample_points;      // on the next generation
+extern bool g_enable_wavefront;
+extern bool g_enable_bidirectional;
+
+extern float g_translucent_cutoff_tolerance; // of the bssrdf relative to its peak, below which sample points are not gathered
+extern bool  g_enable_dipole_lut;
+extern float g_dipole_lut_error;
+extern float g_compact_position_error;
+extern float g_compact_payload_error;
+
+extern UINT g_translucent_ray_budget; // paths of sample collection per frame, 0 for every sample point every frame
+extern UINT g_translucent_update_window;
+extern bool g_enable_translucent_photons; // shoot photons from the emitters instead of tracing paths from the sample points
+extern UINT g_translucent_photons_count;  // per frame
+
+extern bool g_clear_radiance_cache;
+
+extern bool g_fixed_color_emitters;
+
+extern bool g_enable_reprojection;
+extern bool g_reproject_accumulator;
+
+extern UINT            g_aovs; // AOV_* to write, allocated by update_resolution
+extern ID3D12Resource* g_first_hits;
+extern ID3D12Resource* g_first_hit_albedo;
+extern ID3D12Resource* g_first_hit_ids;
+
+extern bool  g_enable_dynamic_resolution;
+extern bool  g_interacting;
+extern float g_interaction_budget_milliseconds;
+extern bool  g_enable_progressive_refinement;
+
+extern UINT g_frame_tiles;
+extern UINT g_cancelled_frames_count;
+
+extern bool                    g_enable_guiding;
+extern bool                    g_reset_guiding;
+extern Array<GuidingIteration> g_guiding_report;
+
+extern double g_render_milliseconds;
+extern double g_rays_per_sample;
+extern double g_pixel_variance;
 
 void init(ID3D12GraphicsCommandList* cmd_list);
+void read_frame_statistics(ID3D12CommandQueue* cmd_queue);
 
 void update_resolution(UINT width, UINT height);
 UINT update_descriptors(DescriptorHandle dest_array);
@@ -80,8 +118,16 @@ void build_tlas(
     Array<ID3D12Resource*>* temp_resources = NULL
 );
 
+// sample points are generated once per translucent mesh in object space, at radius over the largest scale of its instances,
+// and kept while that radius and the layout settings are unchanged, so only the instances' payloads follow build_tlas
+// returns the sample points of all instances
 UINT generate_translucent_samples(ID3D12GraphicsCommandList4* cmd_list, float radius, Array<ID3D12Resource*>* temp_resources = NULL);
 
-void dispatch_rays(ID3D12GraphicsCommandList4* cmd_list);
+// submits the commands recorded so far and waits for them, then resets the command list for recording
+// returns true if the frame is stale and the rest of it should be skipped
+typedef bool (*FlushFrame)(ID3D12GraphicsCommandList4* cmd_list);
+
+// with `flush`, the render dispatch is split into g_frame_tiles bands, and may be cancelled between them
+void dispatch_rays(ID3D12GraphicsCommandList4* cmd_list, FlushFrame flush = NULL);
 
 }
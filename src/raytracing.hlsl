@@ -6,26 +6,71 @@
 
 GlobalRootSignature global_root_signature = {    // SLOT : RESOURCE
     "CBV(b0),"                                      // 0 : g
-    "DescriptorTable(UAV(u0, numDescriptors = 2))," // 1 : { g_render_target, g_sample_accumulator }
+    "DescriptorTable(UAV(u0, numDescriptors = 3))," // 1 : { g_render_target, g_sample_accumulator, g_sample_counts }
     "SRV(t0),"                                      // 2 : g_scene
 
     // translucent materials
     "DescriptorTable("                              // 3 : {
         "SRV(t3, numDescriptors = 2),"              //     g_translucent_bssrdf, g_translucent_properties,
-        "SRV(t6, numDescriptors = unbounded,"       //     g_translucent_samples
+        "SRV(t6, numDescriptors = unbounded,"       //     g_translucent_positions -> [2*i + 0]
+            "offset = 2,"
+            "flags = DESCRIPTORS_VOLATILE),"
+        "SRV(t0, space=3, numDescriptors = unbounded,"  // g_translucent_payloads  -> [2*i + 1]
+            "offset = 2,"
             "flags = DESCRIPTORS_VOLATILE)"
     "),"                                            // }
 
     "DescriptorTable("                              // 4: {
         "SRV(t5, numdescriptors = 1),"              //     g_write_translucent_indices
-        "UAV(u5, numDescriptors = unbounded,"       //     g_write_translucent_samples -> [2*i + 0]
+        "UAV(u5, numDescriptors = unbounded,"       //     g_write_translucent_payloads -> [2*i + 0]
             "offset = 1,"
             "flags = DESCRIPTORS_VOLATILE),"
-        "SRV(t0, space=1, numDescriptors = unbounded,"  // g_point_normals             -> [2*i + 1]
+        "SRV(t0, space=1, numDescriptors = unbounded,"  // g_point_normals              -> [2*i + 1]
             "offset = 1,"
             "flags = DESCRIPTORS_VOLATILE)"
     "),"                                            // }
 
+    // wavefront integrator
+    "RootConstants(b2, num32BitConstants = 4),"     // 5 : wf
+    "DescriptorTable(UAV(u0, space = 2, numDescriptors = 7), UAV(u21, space = 2, numDescriptors = 2))," // 6 : { g_path_*, g_path_queues, g_path_queue_counts, g_path_first_hits, g_path_hits }
+
+    // light sampling
+    "SRV(t0, space = 2),"                           // 7 : g_emitters
+
+    // sampling
+    "SRV(t1, space = 2),"                           // 8 : g_blue_noise_mask
+
+    // radiance cache
+    "UAV(u7, space = 2),"                           // 9 : g_radiance_cache_keys
+    "UAV(u8, space = 2),"                           // 10: g_radiance_cache_values
+
+    // statistics
+    "UAV(u9, space = 2),"                           // 11: g_frame_statistics
+
+    // path guiding
+    "SRV(t2, space = 2),"                           // 12: g_guiding_spatial_nodes
+    "SRV(t3, space = 2),"                           // 13: g_guiding_directional_nodes
+    "UAV(u10, space = 2),"                          // 14: g_guiding_records
+    "UAV(u11, space = 2),"                          // 15: g_guiding_records_count
+
+    // temporal reprojection
+    "DescriptorTable(UAV(u12, space = 2, numDescriptors = 6)),"  // 16: { g_first_hits, g_history_*, g_first_hit_* }
+
+    // cancellable frames
+    "RootConstants(b3, num32BitConstants = 1),"     // 17: tile
+
+    // hierarchical subsurface integration
+    "SRV(t4, space = 2),"                           // 18: g_translucent_nodes
+    "SRV(t5, space = 2),"                           // 19: g_translucent_point_indices
+    "UAV(u18, space = 2),"                          // 20: g_translucent_node_flux
+    "RootConstants(b4, num32BitConstants = 1),"     // 21: refit
+    "SRV(t6, space = 2),"                           // 22: g_translucent_grid_cells
+    "SRV(t7, space = 2),"                           // 23: g_translucent_grid_point_indices
+    "SRV(t8, space = 2),"                           // 24: g_dipole_lut
+    "SRV(t9, space = 2),"                           // 25: g_translucent_grid_positions
+    "UAV(u19, space = 2),"                          // 26: g_translucent_grid_payloads
+    "UAV(u20, space = 2),"                          // 27: g_translucent_photon_flux
+
     // static samplers
     "StaticSampler(s0, addressU=TEXTURE_ADDRESS_BORDER, borderColor=STATIC_BORDER_COLOR_OPAQUE_BLACK)," // BssrdfSampler
 };
@@ -34,19 +79,83 @@ ConstantBuffer<RaytracingGlobals> g                    : register(b0);
 RaytracingAccelerationStructure   g_scene              : register(t0);
 RWTexture2D<float4>               g_render_target      : register(u0);
 RWTexture2D<float4>               g_sample_accumulator : register(u1);
+RWTexture2D<float>                g_sample_counts      : register(u2); // per pixel, which may differ from g.accumulator_count
 
 // TODO: optimized data structure
 Texture1D<float3>                       g_translucent_bssrdf          : register(t3);
 StructuredBuffer<TranslucentProperties> g_translucent_properties      : register(t4);
-// TODO: merge into large buffers for all translucent instances
-StructuredBuffer<SamplePoint>           g_translucent_samples[]       : register(t6);
+// sample points in the object space of their mesh, shared by its instances, and irradiance payloads per instance
+// payloads are the mean flux of the point's updates in xyz and the count of its updates in w
+StructuredBuffer<float3>                g_translucent_positions[]      : register(t6);
+StructuredBuffer<float4>                g_translucent_payloads[]       : register(t0, space3);
 
-StructuredBuffer<uint>                  g_write_translucent_indices   : register(t5);
-RWStructuredBuffer<SamplePoint>         g_write_translucent_samples[] : register(u5);
-Buffer<float3>                          g_point_normals[]             : register(t0, space1);
+StructuredBuffer<uint>                  g_write_translucent_indices    : register(t5);
+RWStructuredBuffer<float4>              g_write_translucent_payloads[] : register(u5);
+StructuredBuffer<float3>                g_point_normals[]              : register(t0, space1);
 
 sampler BssrdfSampler : register(s0);
 
+// wavefront path state in SoA layout, indexed by path id (= linear pixel index)
+ConstantBuffer<WavefrontConstants> wf                  : register(b2);
+RWStructuredBuffer<float3>         g_path_origins      : register(u0, space2);
+RWStructuredBuffer<float4>         g_path_directions   : register(u1, space2); // xyz = direction, w = distance to the hit found by the trace dispatch
+RWStructuredBuffer<float4>         g_path_throughputs  : register(u2, space2); // rgb = throughput, a = scatter pdf
+RWStructuredBuffer<float4>         g_path_radiances    : register(u3, space2);
+RWStructuredBuffer<Sampler>        g_path_rngs         : register(u4, space2);
+// queues of live path ids, as laid out by PATH_*_QUEUE
+RWStructuredBuffer<uint>           g_path_queues       : register(u5, space2); // [queue][path]
+RWStructuredBuffer<uint>           g_path_queue_counts : register(u6, space2); // [queue]
+RWStructuredBuffer<FirstHit>       g_path_first_hits   : register(u21, space2); // of each pixel's first sample, for the resolve
+RWStructuredBuffer<PathHit>        g_path_hits         : register(u22, space2); // surface of the hit found by the trace dispatch
+
+StructuredBuffer<EmitterTriangle>  g_emitters          : register(t0, space2);
+
+StructuredBuffer<float>            g_blue_noise_mask   : register(t1, space2); // BLUE_NOISE_MASK_SIZE^2 ranks in [0, 1)
+
+RWStructuredBuffer<uint>           g_radiance_cache_keys   : register(u7, space2); // [entry] checksum, 0 if empty
+RWByteAddressBuffer                g_radiance_cache_values : register(u8, space2); // [entry] uint4 of rgb fixed-point sums, samples count
+
+RWStructuredBuffer<uint>           g_frame_statistics  : register(u9, space2); // [FRAME_STATISTICS_*]
+
+StructuredBuffer<GuidingSpatialNode>     g_guiding_spatial_nodes     : register(t2, space2);
+StructuredBuffer<GuidingDirectionalNode> g_guiding_directional_nodes : register(t3, space2);
+RWStructuredBuffer<GuidingRecord>        g_guiding_records           : register(u10, space2);
+RWStructuredBuffer<uint>                 g_guiding_records_count     : register(u11, space2); // may exceed GUIDING_RECORDS_CAPACITY
+
+// per-pixel state of temporal reprojection and first hit AOVs, null descriptors while disabled
+RWTexture2D<float4> g_first_hits          : register(u12, space2); // xyz = world normal, w = view depth; 0 on a miss
+RWTexture2D<float4> g_history_accumulator : register(u13, space2); // copies from before the camera moved
+RWTexture2D<float4> g_history_first_hits  : register(u14, space2);
+RWTexture2D<float>  g_history_counts      : register(u15, space2);
+RWTexture2D<float4> g_first_hit_albedo    : register(u16, space2);
+RWTexture2D<uint2>  g_first_hit_ids       : register(u17, space2); // instance index, primitive index; ~0 on a miss
+
+ConstantBuffer<TileConstants> tile : register(b3);
+
+// octrees of all translucent meshes and their flux per instance, at the offsets in their properties
+StructuredBuffer<TranslucentNode>         g_translucent_nodes         : register(t4, space2);
+StructuredBuffer<uint>                    g_translucent_point_indices : register(t5, space2);
+RWStructuredBuffer<float3>                g_translucent_node_flux     : register(u18, space2); // summed payload of the node's points
+ConstantBuffer<TranslucentRefitConstants> refit                       : register(b4);
+
+// uniform grids of all translucent meshes and their payloads per instance, at the offsets in their properties
+StructuredBuffer<uint> g_translucent_grid_cells         : register(t6, space2); // first point index of each cell, and of the end
+StructuredBuffer<uint> g_translucent_grid_point_indices : register(t7, space2);
+// sample points in grid order, split into positions and payloads so that the gather reads contiguous ranges,
+// loading the payloads of only the points within the cutoff radius
+// float3s, or if g.translucent_compact_samples, positions quantized over the grid to 64 bits and RGB9E5 payloads
+ByteAddressBuffer   g_translucent_grid_positions : register(t9, space2);
+RWByteAddressBuffer g_translucent_grid_payloads  : register(u19, space2); // permuted from g_translucent_payloads after collection
+RWByteAddressBuffer g_translucent_photon_flux    : register(u20, space2); // float3s in grid order, deposited by photons of the frame
+
+// TRANSLUCENT_DIPOLE_LUT_SIZE entries of eval_bssrdf_dipole at radius = (i/(size - 1))^2 * g.translucent_dipole_lut_radius
+StructuredBuffer<float3> g_dipole_lut : register(t8, space2);
+
+// ray generation thread of the whole frame, of which a dispatch may cover a band of rows
+inline uint2 dispatch_index() {
+    return DispatchRaysIndex().xy + uint2(0, tile.first_row);
+}
+
 LocalRootSignature local_root_signature = {
     "RootConstants(b1, num32BitConstants = 4)," // 0: l
     "SRV(t1),"                                  // 1: l_vertices
@@ -68,98 +177,991 @@ inline float3 get_world_space_normal(uint3 triangle_indices, float2 barycentrics
 
 // PIPELINE CONFIGURATION
 
+#define PAYLOAD_IGNORE_TRANSLUCENT_EMISSION 0x1
+#define PAYLOAD_SKIP_LIGHT_SAMPLING         0x2
+#define PAYLOAD_SKIP_GUIDING                0x4
+#define PAYLOAD_WRITE_IDS                   0x8
+#define PAYLOAD_DEPOSIT_PHOTON              0x10 // in: emission is the flux of a photon, deposited by translucent hits
+#define PAYLOAD_CLASSIFY                    0x20 // in: only t and shader are returned, by classify_hit
+
 struct RayPayload {
-    uint   rng;
+    Sampler rng;
+    uint   bounce_index; // in
+    uint   flags;        // in: PAYLOAD_*
     float  t;
     float3 scatter;
     float3 reflectance;
     float3 emission;
+    float  pdf;          // solid angle pdf of `scatter`, or of light sampling the hit point for emitters
+    float3 normal;       // shading normal, facing the incoming ray
+    float3 albedo;
+    uint   shader;
+    uint2  ids;          // instance index, primitive index of PAYLOAD_WRITE_IDS rays
 };
 
 typedef BuiltInTriangleIntersectionAttributes Attributes;
 
 RaytracingShaderConfig shader_config = {
-    44, // max payload size
+    104, // max payload size
     8   // max attribute size
 };
 
 RaytracingPipelineConfig pipeline_config = {
-    1   // max recursion depth
+    2   // max recursion depth: shadow rays are traced from hit shaders
 };
 
 // SHADER CODE
-#define IGNORE_TRANSLUCENT_EMISSION true
-float4 trace_path_sample(inout uint rng, inout RayDesc ray, bool ignore_translucent_emission = false) {
-    float4 result = 0;
 
-    RayPayload payload;
-    payload.rng = rng;
-
-    float3 radiance    = 0;
-    float3 reflectance = 1;
-    uint bounce_index;
-    for (bounce_index = 0; bounce_index <= g.bounces_per_sample; bounce_index++) {
-        payload.t = bounce_index;
-        if (ignore_translucent_emission) {
-            // HACK: currently only translucent materials use payload.t to check bounce index within hit shader
-            // ignore translucent emission by setting to infinity
-            payload.t = INFINITY;
+// diffuse bounces are cosine-weighted, so the lambert term cancels with the sample pdf
+// estimators are scaled by the mean cosine of the hemisphere to keep the normalization of the previous uniform sampler
+#define MEAN_HEMISPHERE_COSINE 0.5
+
+// count the rays traced by the active lanes, with one atomic per wave
+inline void count_rays() {
+    uint count = WaveActiveCountBits(true);
+    if (WaveIsFirstLane()) InterlockedAdd(g_frame_statistics[FRAME_STATISTICS_RAY_COUNT], count);
+}
+
+// add the pixel variance of the active lanes to the 64-bit fixed-point sum, with one atomic per wave
+inline void count_pixel_variance(float variance) {
+    uint value = (uint) (min(variance, 4096) * FRAME_STATISTICS_FIXED_POINT + 0.5);
+    uint sum   = WaveActiveSum(value);
+    if (WaveIsFirstLane()) {
+        uint previous;
+        InterlockedAdd(g_frame_statistics[FRAME_STATISTICS_PIXEL_VARIANCE + 0], sum, previous);
+        if (previous + sum < previous) InterlockedAdd(g_frame_statistics[FRAME_STATISTICS_PIXEL_VARIANCE + 1], 1); // carry
+    }
+}
+
+// power heuristic for multiple importance sampling, with beta = 2
+inline float mis_weight(float pdf, float other_pdf) {
+    float a = pdf*pdf;
+    float b = other_pdf*other_pdf;
+    return a / (a + b);
+}
+
+inline bool is_light_sampling_enabled() {
+    return g.light_sampling && g.emitters_count > 0;
+}
+
+inline uint sample_emitter_index(float area) {
+    // binary search for the first triangle whose cdf covers the sampled area
+    uint lower = 0;
+    uint upper = g.emitters_count - 1;
+    while (lower < upper) {
+        uint middle = (lower + upper) / 2;
+        if (g_emitters[middle].cdf < area) lower = middle + 1;
+        else                               upper = middle;
+    }
+    return lower;
+}
+
+// solid angle pdf of sampling a point on an emitter from `distance` away, where the emitter faces the sampled direction by `cosine`
+inline float light_sampling_pdf(float distance, float cosine) {
+    return distance*distance / (cosine * g.emitters_total_area);
+}
+
+// uniformly sample a point on the emitters by area, with pdf 1/g.emitters_total_area
+EmitterTriangle sample_emitter(inout Sampler rng, out float3 light_point) {
+    EmitterTriangle emitter = g_emitters[sample_emitter_index(random01(rng) * g.emitters_total_area)];
+
+    float2 uv = float2(random01(rng), random01(rng));
+    if (uv.x + uv.y > 1) uv = 1 - uv; // fold back into the triangle
+    light_point = emitter.position + uv.x*emitter.edge1 + uv.y*emitter.edge2;
+    return emitter;
+}
+
+inline float3 get_emitter_color(EmitterTriangle emitter) {
+    if (any(emitter.color)) return emitter.color;
+    else                    return g.light_color;
+}
+
+// shadow ray: any hit before `distance` occludes the target point
+bool is_visible(float3 position, float3 direction, float distance) {
+    RayDesc ray;
+    ray.Origin    = position;
+    ray.Direction = direction;
+    ray.TMin      = 0.0001;
+    ray.TMax      = distance * 0.999;
+
+    RayPayload shadow = (RayPayload) 0;
+    count_rays();
+    TraceRay(
+        g_scene, RAY_FLAG_CULL_BACK_FACING_TRIANGLES | RAY_FLAG_ACCEPT_FIRST_HIT_AND_END_SEARCH | RAY_FLAG_SKIP_CLOSEST_HIT_SHADER, 0xff,
+        0, 1, 0,
+        ray, shadow
+    );
+    return isinf(shadow.t);
+}
+
+// path guiding
+// scattering materials mix their cosine-weighted sample with a directional distribution learned per region of space,
+// after Müller et al. 2017, "Practical Path Guiding for Efficient Light-Transport Simulation". the distributions are
+// trained on the host from radiance records of previous iterations, see guiding.cpp
+
+#define GUIDING_DISABLED      0xffffffff
+#define GUIDING_BSDF_FRACTION 0.5 // of scatter directions drawn from the bsdf
+
+// returns the directional tree root of the spatial leaf containing `position`
+uint guiding_find_directional_root(float3 position) {
+    float3 lower = g.guiding_aabb_min;
+    float3 upper = g.guiding_aabb_max;
+
+    uint node = 0;
+    while (true) {
+        GuidingSpatialNode spatial = g_guiding_spatial_nodes[node];
+        if (spatial.axis == GUIDING_LEAF) return spatial.child;
+
+        float middle = 0.5 * (lower[spatial.axis] + upper[spatial.axis]);
+        if (position[spatial.axis] < middle) { upper[spatial.axis] = middle; node = spatial.child;     }
+        else                                 { lower[spatial.axis] = middle; node = spatial.child + 1; }
+    }
+}
+
+inline float3 guiding_square_to_direction(float2 p) {
+    float cos_theta = 2*p.x - 1;
+    float sin_theta = sqrt(max(0, 1 - cos_theta*cos_theta));
+    float phi       = TAU * p.y;
+    return float3(sin_theta*cos(phi), sin_theta*sin(phi), cos_theta);
+}
+
+inline float2 guiding_direction_to_square(float3 direction) {
+    return float2(0.5*(clamp(direction.z, -1, 1) + 1), frac(atan2(direction.y, direction.x) / TAU));
+}
+
+inline float safe_divide(float a, float b) {
+    return b > 0 ? a / b : 0;
+}
+
+// warp `u` down the quadtree: pick a column of quadrants, then a quadrant in it, rescaling `u` to the quadrant
+float3 guiding_sample(uint node, float2 u) {
+    float2 origin = 0;
+    float  size   = 1;
+    for (uint depth = 0; depth < GUIDING_MAX_DEPTH; depth++) {
+        GuidingDirectionalNode directional = g_guiding_directional_nodes[node];
+        float4 e = directional.energy;
+        if (!any(e)) break; // uniform below this node
+
+        float left = safe_divide(e.x + e.z, e.x + e.y + e.z + e.w);
+        uint  qx   = u.x >= left;
+        u.x = qx ? safe_divide(u.x - left, 1 - left) : safe_divide(u.x, left);
+
+        float bottom = qx ? safe_divide(e.y, e.y + e.w) : safe_divide(e.x, e.x + e.z);
+        uint  qy     = u.y >= bottom;
+        u.y = qy ? safe_divide(u.y - bottom, 1 - bottom) : safe_divide(u.y, bottom);
+
+        size   *= 0.5;
+        origin += size * float2(qx, qy);
+
+        uint child = directional.child[qx + 2*qy];
+        if (child == 0) break;
+        node = child;
+    }
+    return guiding_square_to_direction(origin + size*saturate(u));
+}
+
+// solid angle pdf of guiding_sample
+float guiding_pdf(uint node, float3 direction) {
+    float2 p       = guiding_direction_to_square(direction);
+    float  density = 1; // with respect to the unit square
+    for (uint depth = 0; depth < GUIDING_MAX_DEPTH; depth++) {
+        GuidingDirectionalNode directional = g_guiding_directional_nodes[node];
+        float4 e     = directional.energy;
+        float  total = e.x + e.y + e.z + e.w;
+        if (total <= 0) break;
+
+        uint2 q = min(p * 2, 1);
+        uint  i = q.x + 2*q.y;
+        density *= 4 * e[i] / total;
+
+        uint child = directional.child[i];
+        if (child == 0) break;
+        node = child;
+        p    = p*2 - q;
+    }
+    return density / (2*TAU); // the unit square maps to the 4 pi sphere
+}
+
+// GUIDING_DISABLED if scatter directions are not guided at `position`
+inline uint guiding_node(float3 position, uint payload_flags) {
+    if (!g.guiding_sampling || (payload_flags & PAYLOAD_SKIP_GUIDING)) return GUIDING_DISABLED;
+    return guiding_find_directional_root(position);
+}
+
+// solid angle pdf of sample_scatter
+float scatter_pdf(uint node, float3 normal, float3 direction) {
+    float pdf = max(0, dot(normal, direction)) / (TAU/2);
+    if (node == GUIDING_DISABLED) return pdf;
+    return GUIDING_BSDF_FRACTION*pdf + (1 - GUIDING_BSDF_FRACTION)*guiding_pdf(node, direction);
+}
+
+// cosine-weighted sample of the hemisphere around `normal`, mixed with the guiding distribution at `node`
+// guided directions may fall below the surface; their cosine is then negative and the path terminates
+float3 sample_scatter(inout Sampler rng, uint node, float3 normal, out float pdf) {
+    float3 direction;
+    if (node == GUIDING_DISABLED) {
+        direction = random_cosine_on_hemisphere(rng, normal);
+        random01(rng); // keep the dimensions of the bounce aligned with guided samples
+    } else {
+        bool  guided = random01(rng) >= GUIDING_BSDF_FRACTION;
+        float2 u     = float2(random01(rng), random01(rng));
+        if (guided) direction = guiding_sample(node, u);
+        else        direction = cosine_on_hemisphere(u, normal);
+    }
+    pdf = scatter_pdf(node, normal, direction);
+    return direction;
+}
+
+// next-event estimation: sample a point on the emitters by area and trace a shadow ray towards it
+// returns the mis-weighted incident radiance times the surface cosine over the sample pdf; scale by the brdf to get the outgoing radiance
+float3 sample_direct_lighting(inout Sampler rng, uint guiding, float3 position, float3 normal, out float3 direction) {
+    float3 light_point;
+    EmitterTriangle emitter = sample_emitter(rng, light_point);
+
+    float3 offset   = light_point - position;
+    float  distance = length(offset);
+    direction = offset / distance;
+
+    float surface_cosine = dot(normal, direction);
+    float light_cosine   = -dot(emitter.normal, direction);
+    if (surface_cosine <= 0 || light_cosine <= 0) return 0;
+    if (!is_visible(position, direction, distance)) return 0;
+
+    float3 emission = get_emitter_color(emitter) * light_cosine; // matches light_chit
+
+    float light_pdf = light_sampling_pdf(distance, light_cosine);
+    float brdf_pdf  = scatter_pdf(guiding, normal, direction); // all scattering materials sample with sample_scatter
+    return emission * surface_cosine / light_pdf * mis_weight(light_pdf, brdf_pdf);
+}
+
+// radiance cache
+// world-space hash grid storing the averaged outgoing radiance of scattering surfaces per cell and normal bucket
+// entries are claimed with a compare-exchange on their checksum, and accumulated with fixed-point atomic adds
+// an update claims a sample of the count before adding to the sums, so a lookup racing with updates may read a count
+// whose sums are still missing: lookups drop entries whose count moved while they were read, and accept the remaining
+// bias of at most the concurrently added samples against the at least g.radiance_cache_min_samples of the entry
+
+#define RADIANCE_CACHE_INVALID        0xffffffff
+#define RADIANCE_CACHE_PROBES         8      // linear probing distance before giving up on a cell
+#define RADIANCE_CACHE_FIXED_POINT    16384.0 // per unit of radiance_cache_light_unit
+#define RADIANCE_CACHE_MAX_RADIANCE   4.0     // per-sample clamp in light units, keeps the fixed-point sums from overflowing
+#define RADIANCE_CACHE_MAX_SAMPLES    4096   // converged entries stop accumulating
+#define RADIANCE_CACHE_TRAINING_RATIO 8      // one in this many paths ignores the cache and trains it
+
+// radiance is cached relative to the brightest channel of the light color, which is 1 with light-linear accumulation,
+// so that the fixed-point precision and the clamp follow the signal whether or not the light color is factored out
+// the light color is fixed while the cache accumulates, as editing it otherwise clears the cache
+inline float radiance_cache_light_unit() {
+    return max(max(g.light_color.r, g.light_color.g), max(g.light_color.b, 1e-6));
+}
+
+inline uint radiance_cache_normal_bucket(float3 normal) {
+    // dominant axis and its sign
+    float3 a = abs(normal);
+    uint axis = a.x > a.y ? (a.x > a.z ? 0 : 2) : (a.y > a.z ? 1 : 2);
+    return 2*axis + (normal[axis] < 0);
+}
+
+// returns the entry of the cell containing `position`, inserting it if `insert` is set
+// returns RADIANCE_CACHE_INVALID if the cell is not cached, or if its probe sequence is full
+uint radiance_cache_find(float3 position, float3 normal, bool insert) {
+    int3 cell   = (int3) floor(position / g.radiance_cache_cell_size);
+    uint bucket = radiance_cache_normal_bucket(normal);
+
+    uint index    = hash(uint4(asuint(cell), bucket));
+    uint checksum = hash(uint4(bucket, asuint(cell.zyx))) | 1; // 0 marks empty entries
+
+    for (uint i = 0; i < RADIANCE_CACHE_PROBES; i++) {
+        uint entry = (index + i) % RADIANCE_CACHE_CAPACITY;
+        uint key   = g_radiance_cache_keys[entry];
+        if (key == checksum) return entry;
+        if (key == 0) {
+            if (!insert) return RADIANCE_CACHE_INVALID; // cells are inserted into the first empty entry of their sequence
+
+            uint previous;
+            InterlockedCompareExchange(g_radiance_cache_keys[entry], 0, checksum, previous);
+            if (previous == 0 || previous == checksum) return entry;
         }
-        TraceRay(
-            g_scene, RAY_FLAG_CULL_BACK_FACING_TRIANGLES, 0xff,
-            0, 1, 0,
-            ray, payload
-        );
-        radiance    += payload.emission * reflectance;
-        reflectance *= payload.reflectance;
+    }
+    return RADIANCE_CACHE_INVALID;
+}
+
+bool radiance_cache_lookup(float3 position, float3 normal, out float3 radiance) {
+    radiance = 0;
+
+    uint entry = radiance_cache_find(position, normal, false);
+    if (entry == RADIANCE_CACHE_INVALID) return false;
 
-        if (!any(payload.reflectance)) break;
+    uint4 value = g_radiance_cache_values.Load4(16*entry);
+    if (value.a < max(1, g.radiance_cache_min_samples)) return false;
+    if (g_radiance_cache_values.Load(16*entry + 12) != value.a) return false; // updated while reading
 
-        ray.Origin   += payload.t * ray.Direction;
-        ray.Direction = payload.scatter;
+    radiance = value.rgb / (RADIANCE_CACHE_FIXED_POINT * value.a) * radiance_cache_light_unit();
+    return true;
+}
+
+void radiance_cache_update(float3 position, float3 normal, float3 radiance) {
+    if (any(isnan(radiance))) return;
+
+    uint entry = radiance_cache_find(position, normal, true);
+    if (entry == RADIANCE_CACHE_INVALID) return;
+    // claim a sample while the entry has not converged, so that its count never exceeds RADIANCE_CACHE_MAX_SAMPLES
+    uint count = g_radiance_cache_values.Load(16*entry + 12);
+    while (count < RADIANCE_CACHE_MAX_SAMPLES) {
+        uint previous;
+        g_radiance_cache_values.InterlockedCompareExchange(16*entry + 12, count, count + 1, previous);
+        if (previous == count) break;
+        count = previous;
     }
-    result.rgb = radiance;
-    result.a   = !(bounce_index == 0 && isinf(payload.t));
+    if (count >= RADIANCE_CACHE_MAX_SAMPLES) return;
 
-    rng = payload.rng; // write rng back out
-    return result;
+    uint3 value = (uint3) (clamp(radiance / radiance_cache_light_unit(), 0, RADIANCE_CACHE_MAX_RADIANCE) * RADIANCE_CACHE_FIXED_POINT + 0.5);
+    g_radiance_cache_values.InterlockedAdd(16*entry + 0, value.r);
+    g_radiance_cache_values.InterlockedAdd(16*entry + 4, value.g);
+    g_radiance_cache_values.InterlockedAdd(16*entry + 8, value.b);
 }
 
 [shader("raygeneration")]
-void camera_rgen() {
-    uint rng = hash(uint3(DispatchRaysIndex().xy, g.frame_rng*(g.accumulator_count != 0)));
+void radiance_cache_clear_rgen() {
+    uint entry = DispatchRaysIndex().x;
+    g_radiance_cache_keys[entry] = 0;
+    g_radiance_cache_values.Store4(16*entry, 0);
+}
+
+#define RADIANCE_CACHE_DISABLED 0
+#define RADIANCE_CACHE_LOOKUP   1 // terminate into the cache when its entry is usable
+#define RADIANCE_CACHE_TRAIN    2 // trace to full depth and update the cache
+
+struct PathState {
+    RayDesc ray;
+    float3  throughput;
+    float4  radiance;    // rgb = radiance, a = coverage
+    Sampler rng;
+    float   scatter_pdf; // pdf of the last scatter direction, 0 if the ray was not scattered by a material
+
+    // vertex at bounce g.radiance_cache_depth, whose outgoing radiance is added to the cache when the path ends
+    uint    cache_mode;       // RADIANCE_CACHE_*
+    float3  cache_position;
+    float3  cache_normal;
+    float3  cache_throughput; // throughput arriving at the vertex, 0 if there is no vertex to update
+    float3  cache_radiance;   // radiance gathered before the vertex
+
+    FirstHit first_hit; // of bounce 0
+};
+
+inline PathState path_init(Sampler rng, RayDesc ray) {
+    PathState path;
+    path.ray         = ray;
+    path.throughput  = 1;
+    path.radiance    = 0;
+    path.rng         = rng;
+    path.scatter_pdf = 0;
+
+    path.cache_mode       = RADIANCE_CACHE_DISABLED;
+    path.cache_position   = 0;
+    path.cache_normal     = 0;
+    path.cache_throughput = 0;
+    path.cache_radiance   = 0;
+
+    path.first_hit.t      = INFINITY;
+    path.first_hit.normal = 0;
+    path.first_hit.albedo = 0;
+    path.first_hit.ids    = ~0;
+    return path;
+}
+
+#define SAMPLER_CAMERA_DIMENSIONS 2 // pixel offset, or the direction leaving a translucent sample point
+#define SAMPLER_BOUNCE_DIMENSIONS 8 // light sample (3), scatter direction (3), russian roulette (1)
+
+// payload of the path's next segment
+RayPayload path_payload(inout PathState path, uint bounce_index, bool ignore_translucent_emission) {
+    // each bounce draws from its own range of sampler dimensions
+    path.rng.dimension = SAMPLER_CAMERA_DIMENSIONS + bounce_index*SAMPLER_BOUNCE_DIMENSIONS;
+
+    RayPayload payload;
+    payload.rng                         = path.rng;
+    payload.bounce_index                = bounce_index;
+    payload.flags                       = ignore_translucent_emission ? PAYLOAD_IGNORE_TRANSLUCENT_EMISSION : 0;
+    payload.pdf                         = 0;
+    payload.shader                      = Shader::Count;
+    payload.ids                         = ~0;
+    if (bounce_index == 0 && (g.aovs & AOV_IDS)) payload.flags |= PAYLOAD_WRITE_IDS;
+    return payload;
+}
+
+// add the shaded hit of the path's next segment and scatter at it
+// returns false if the path was terminated
+bool scatter_path(inout PathState path, uint bounce_index, RayPayload payload) {
+    if (bounce_index == 0 && !isinf(payload.t)) {
+        path.first_hit.t      = payload.t;
+        path.first_hit.normal = payload.normal;
+        path.first_hit.albedo = payload.albedo;
+        path.first_hit.ids    = payload.ids;
+    }
+
+    if (path.cache_mode != RADIANCE_CACHE_DISABLED && bounce_index == g.radiance_cache_depth && any(payload.reflectance)) {
+        float3 position = path.ray.Origin + payload.t * path.ray.Direction;
+
+        // the cached outgoing radiance replaces the emission and the rest of the path
+        float3 cached;
+        if (path.cache_mode == RADIANCE_CACHE_LOOKUP && radiance_cache_lookup(position, payload.normal, cached)) {
+            path.rng           = payload.rng;
+            path.radiance.rgb += cached * path.throughput;
+            return false;
+        }
+
+        path.cache_position   = position;
+        path.cache_normal     = payload.normal;
+        path.cache_throughput = path.throughput;
+        path.cache_radiance   = path.radiance.rgb;
+    }
 
+    // emitters hit by a scattered ray were also sampled explicitly at the previous hit
+    float3 emission = payload.emission;
+    if (payload.shader == Shader::Light && path.scatter_pdf > 0 && is_light_sampling_enabled()) {
+        emission *= mis_weight(path.scatter_pdf, payload.pdf);
+    }
+
+    path.rng           = payload.rng;
+    path.radiance.rgb += emission * path.throughput;
+    path.throughput   *= payload.reflectance;
+    if (bounce_index == 0) path.radiance.a += !isinf(payload.t);
+
+    if (!any(payload.reflectance)) return false;
+
+    // russian roulette: terminate low-throughput paths and reweight the survivors
+    if (bounce_index >= g.roulette_min_bounces) {
+        float survival = min(1, max(path.throughput.r, max(path.throughput.g, path.throughput.b)));
+        if (random01(path.rng) >= survival) return false;
+        path.throughput /= survival;
+    }
+
+    path.ray.Origin   += payload.t * path.ray.Direction;
+    path.ray.Direction = payload.scatter;
+    path.scatter_pdf   = payload.pdf;
+    return true;
+}
+
+// trace a single segment of the path and scatter at the hit point
+// returns false if the path was terminated; `shader` is set to the material at the hit point
+bool extend_path(inout PathState path, uint bounce_index, bool ignore_translucent_emission, out uint shader) {
+    RayPayload payload = path_payload(path, bounce_index, ignore_translucent_emission);
+    count_rays();
+    TraceRay(
+        g_scene, RAY_FLAG_CULL_BACK_FACING_TRIANGLES, 0xff,
+        0, 1, 0,
+        path.ray, payload
+    );
+
+    shader = payload.shader;
+    return scatter_path(path, bounce_index, payload);
+}
+
+inline uint path_split_factor(float3 throughput) {
+    if (g.split_threshold <= 0) return 1;
+    return max(1, (uint) (max(throughput.r, max(throughput.g, throughput.b)) / g.split_threshold));
+}
+
+#define PATH_SPLIT_STACK_SIZE 4
+
+#define GUIDING_RECORDED_VERTICES 4
+
+#define IGNORE_TRANSLUCENT_EMISSION true
+float4 trace_path_sample(inout Sampler rng, inout RayDesc ray, out FirstHit first_hit, bool ignore_translucent_emission = false) {
+    PathState path = path_init(rng, ray);
+
+    // the cache holds the radiance of camera paths, including translucent emission
+    // splitting is disabled with the cache, since the cache vertex must see all of its path's radiance
+    if (g.radiance_cache_depth > 0 && !ignore_translucent_emission) {
+        bool train = hash(uint4(dispatch_index(), rng.index, rng.seed)) % RADIANCE_CACHE_TRAINING_RATIO == 0;
+        path.cache_mode = train ? RADIANCE_CACHE_TRAIN : RADIANCE_CACHE_LOOKUP;
+    }
+
+    // vertices whose incident radiance trains the guiding distribution
+    // splitting is disabled while recording, since each vertex must see all of its path's radiance
+    GuidingRecord records           [GUIDING_RECORDED_VERTICES];
+    float3        record_throughputs[GUIDING_RECORDED_VERTICES]; // throughput leaving the vertex
+    float3        record_radiances  [GUIDING_RECORDED_VERTICES]; // radiance gathered up to and including the vertex
+    uint          records_count = 0;
+
+    bool record = false;
+    if (g.guiding_record_probability > 0 && !ignore_translucent_emission) {
+        float u = (hash(uint4(dispatch_index(), rng.seed, rng.index + 1)) >> 8) / 16777216.0;
+        record = u < g.guiding_record_probability;
+    }
+
+    // branches of split paths waiting to be traced
+    PathState split_paths  [PATH_SPLIT_STACK_SIZE];
+    uint      split_bounces[PATH_SPLIT_STACK_SIZE];
+    uint      split_count = 0;
+
+    float4 radiance     = 0;
+    uint   bounce_index = 0;
+    while (true) {
+        uint shader;
+        if (bounce_index <= g.bounces_per_sample && extend_path(path, bounce_index, ignore_translucent_emission, shader)) {
+            bounce_index += 1;
+
+            if (record && records_count < GUIDING_RECORDED_VERTICES && path.scatter_pdf > 0) {
+                records[records_count].position  = path.ray.Origin;
+                records[records_count].direction = path.ray.Direction;
+                records[records_count].pdf       = path.scatter_pdf;
+                record_throughputs[records_count] = path.throughput;
+                record_radiances  [records_count] = path.radiance.rgb;
+                records_count += 1;
+            }
+
+            // split high-throughput paths, sharing the throughput between the branches
+            // branches retrace the next segment with their own random sequence, so they scatter independently at its hit
+            uint branches = min(path_split_factor(path.throughput), 1 + PATH_SPLIT_STACK_SIZE - split_count);
+            if (path.cache_mode != RADIANCE_CACHE_DISABLED || record) branches = 1;
+            if (branches > 1) {
+                path.throughput /= branches;
+                for (uint i = 1; i < branches; i++) {
+                    PathState branch = path;
+                    branch.radiance  = 0;
+                    branch.rng.seed  = hash(uint3(path.rng.seed, i, bounce_index)); // rescramble
+
+                    split_paths  [split_count] = branch;
+                    split_bounces[split_count] = bounce_index;
+                    split_count += 1;
+                }
+            }
+            continue;
+        }
+
+        // path terminated: update the cache with the radiance leaving its vertex
+        if (any(path.cache_throughput)) {
+            float3 outgoing = (path.radiance.rgb - path.cache_radiance) / max(path.cache_throughput, 1e-6) * (path.cache_throughput > 0);
+            radiance_cache_update(path.cache_position, path.cache_normal, outgoing);
+        }
+
+        // incident radiance along each recorded scatter direction
+        if (records_count > 0) {
+            uint slot;
+            InterlockedAdd(g_guiding_records_count[0], records_count, slot);
+            for (uint i = 0; i < records_count && slot + i < GUIDING_RECORDS_CAPACITY; i++) {
+                float3 incident = (path.radiance.rgb - record_radiances[i]) / max(record_throughputs[i], 1e-6) * (record_throughputs[i] > 0);
+                records[i].radiance = luminance(incident);
+                g_guiding_records[slot + i] = records[i];
+            }
+        }
+
+        // resume the most recent branch
+        radiance += path.radiance;
+        if (split_count == 0) break;
+
+        split_count -= 1;
+        path         = split_paths  [split_count];
+        bounce_index = split_bounces[split_count];
+    }
+    rng       = path.rng; // write rng back out
+    ray       = path.ray;
+    first_hit = path.first_hit; // shared by the branches
+    return radiance;
+}
+
+// size of the render target, of which each ray generation thread covers a block of g.render_scale^2 pixels
+inline uint2 render_dimensions() {
+    uint2 dimensions;
+    g_render_target.GetDimensions(dimensions.x, dimensions.y);
+    return dimensions;
+}
+
+// the pixel of the thread's block which is traced, may lie past the edges of the render target
+inline uint2 traced_pixel() {
+    return dispatch_index()*g.render_scale + g.render_offset;
+}
+
+// `offset` in [-0.5, 0.5] from the pixel center
+RayDesc generate_camera_ray(float2 offset) {
     RayDesc ray;
     ray.TMin = 0.000001;
     ray.TMax = 10000;
 
+    ray.Origin = g.camera_to_world[3].xyz / g.camera_to_world[3].w;
+
+    ray.Direction.xy  = traced_pixel() + 0.5 + offset;                 // pixel centers
+    ray.Direction.xy  = 2*ray.Direction.xy / render_dimensions() - 1; // normalize to clip coordinates
+    ray.Direction.x  *= g.camera_aspect;
+    ray.Direction.y  *= -1;
+    ray.Direction.z   = -g.camera_focal_length;
+    ray.Direction     = normalize(mul(float4(ray.Direction, 0), g.camera_to_world).xyz);
+    return ray;
+}
+
+RayDesc generate_camera_ray(inout Sampler rng) {
+    return generate_camera_ray(0.5 * float2(random11(rng), random11(rng))); // random offset inside pixel
+}
+
+inline Sampler generate_pixel_sampler(uint2 pixel, uint sample_index) {
+    if (!g.low_discrepancy_sampling) {
+        return sampler_init_random(hash(uint4(pixel, g.frame_rng*(g.accumulator_count != 0), sample_index)));
+    }
+    // all pixels share one scrambled sequence, decorrelated by their blue-noise rotation
+    // each pixel continues from its own sample count, since pixels skipped by a cancelled frame fall behind the others
+    uint2 mask_pixel = pixel % BLUE_NOISE_MASK_SIZE;
+    float rotation   = g_blue_noise_mask[mask_pixel.y*BLUE_NOISE_MASK_SIZE + mask_pixel.x];
+    uint  frames     = g.accumulator_count != 0 ? (uint) g_sample_counts[pixel] : 0;
+    return sampler_init_sobol(g.sampler_seed, frames*g.samples_per_pixel + sample_index, rotation);
+}
+
+// temporal reprojection
+// while enabled, each pixel keeps its own sample count, and camera motion warps the samples accumulated in the previous
+// view into the new one instead of discarding them. pixels are matched through the first hit of their first sample's
+// camera ray, recorded by the integrator, and history whose view depth or normal disagrees with the new first hit is
+// rejected, restarting the pixel.
+
+#define REPROJECTION_DEPTH_TOLERANCE  0.05 // relative to the previous view depth
+#define REPROJECTION_NORMAL_TOLERANCE 0.9  // minimum cosine between the normals
+
+// surface at a hit point, from which the materials are shaded
+// resolved by the hit shaders, or loaded by the wavefront shade dispatches from the hit stored by the trace dispatch
+struct SurfaceHit {
+    float3 position;
+    float3 direction;         // of the incoming ray
+    float  t;
+    float3 normal;            // shading normal, facing the incoming ray
+    float3 object_position;   // in the object space of the mesh, as its translucent sample points
+    float3 color;             // of the instance's material
+    uint   translucent_index; // of the instance's translucent properties and sample points
+    uint2  ids;               // instance index, primitive index
+};
+
+SurfaceHit surface_hit(Attributes attr) {
+    SurfaceHit hit;
+    hit.t                 = RayTCurrent();
+    hit.direction         = WorldRayDirection();
+    hit.position          = WorldRayOrigin() + hit.t*hit.direction;
+    hit.normal            = get_world_space_normal(load_3x16bit_indices(l_indices, PrimitiveIndex()), attr.barycentrics);
+    hit.object_position   = ObjectRayOrigin() + hit.t*ObjectRayDirection();
+    hit.color             = l.color;
+    hit.translucent_index = l.translucent_id * g.translucent_instance_stride + InstanceID();
+    hit.ids               = uint2(InstanceIndex(), PrimitiveIndex());
+    return hit;
+}
+
+// hit shaders return the surface of PAYLOAD_CLASSIFY rays unshaded, by which the wavefront integrator bins paths
+// besides t, normal, shader and ids, the object position is returned in `scatter`, the color in `albedo` and the
+// translucent index in `pdf`, as read by wavefront_trace_rgen
+inline bool classify_hit(inout RayPayload payload, uint shader, SurfaceHit hit) {
+    if (!(payload.flags & PAYLOAD_CLASSIFY)) return false;
+    payload.t       = hit.t;
+    payload.normal  = hit.normal;
+    payload.scatter = hit.object_position;
+    payload.albedo  = hit.color;
+    payload.pdf     = asfloat(hit.translucent_index);
+    payload.ids     = hit.ids;
+    payload.shader  = shader;
+    return true;
+}
+
+// hit shaders return the ids of PAYLOAD_WRITE_IDS rays, the first segments of camera paths while AOV_IDS is written
+inline void write_hit_ids(inout RayPayload payload, SurfaceHit hit) {
+    if (payload.flags & PAYLOAD_WRITE_IDS) payload.ids = hit.ids;
+}
+
+inline float4 first_hit_value(RayDesc ray, FirstHit hit) {
+    if (isinf(hit.t)) return 0;
+    float view_depth = hit.t * dot(ray.Direction, -g.camera_to_world[2].xyz);
+    return float4(hit.normal, view_depth);
+}
+
+// bilinearly resample the previous view's history at the projection of the first hit, rejecting taps by depth and normal
+// returns the number of samples kept, capped at g.reprojection_max_samples, with their sum in `history`
+float reproject_history(RayDesc ray, FirstHit hit, out float4 history) {
+    history = 0;
+
+    // misses are reprojected by their direction
+    bool   miss     = isinf(hit.t);
+    float4 position = miss ? float4(ray.Direction, 0) : float4(ray.Origin + hit.t*ray.Direction, 1);
+    float3 view     = mul(position, g.previous_world_to_camera).xyz;
+    if (view.z >= 0) return 0; // behind the previous camera
+
+    // inverse of generate_camera_ray
+    float2 clip  = view.xy * g.previous_camera_focal_length / -view.z;
+    clip.x      /= g.camera_aspect;
+    clip.y      *= -1;
+    float2 pixel = (clip + 1) / 2 * render_dimensions() - 0.5;
+
+    int2   base    = (int2) floor(pixel);
+    float2 f       = pixel - base;
+    float  weights = 0;
+    float  count   = 0;
+    for (uint i = 0; i < 4; i++) {
+        int2 tap = base + int2(i % 2, i / 2);
+        if (any(tap < 0) || any(tap >= (int2) render_dimensions())) continue;
+
+        float  tap_count = g_history_counts[tap];
+        float4 tap_hit   = g_history_first_hits[tap];
+        if (tap_count <= 0 || miss != (tap_hit.w == 0)) continue;
+        if (!miss) {
+            if (abs(-view.z - tap_hit.w) > REPROJECTION_DEPTH_TOLERANCE*tap_hit.w) continue;
+            if (dot(hit.normal, tap_hit.xyz) < REPROJECTION_NORMAL_TOLERANCE)     continue;
+        }
+
+        float weight = (i % 2 ? f.x : 1 - f.x) * (i / 2 ? f.y : 1 - f.y);
+        history += weight * g_history_accumulator[tap] / tap_count;
+        count   += weight * tap_count;
+        weights += weight;
+    }
+    if (weights <= 0) return 0;
+
+    count    = min(count / weights, (float) g.reprojection_max_samples);
+    history *= count / weights;
+    return count;
+}
+
+// `ray` and `hit` are the camera ray of the pixel's first sample and its first hit
+void write_accumulated_samples(float4 accumulated_samples, RayDesc ray, FirstHit hit) {
+    uint2 pixel = traced_pixel();
+
+    // add previous samples of the pixel
+    float  count   = 0;
+    float4 history = 0;
+    bool   reprojected = false;
+    float4 first_hit = 0, first_hit_albedo = 0;
+    uint2  first_hit_id = ~0;
+    if (g.reprojection || g.aovs) {
+        if (g.reprojection && g.reproject_history) {
+            count       = reproject_history(ray, hit, history);
+            reprojected = true;
+        }
+        first_hit        = first_hit_value(ray, hit);
+        first_hit_albedo = float4(hit.albedo, 1);
+        first_hit_id     = hit.ids;
+        if (g.reprojection || (g.aovs & AOV_NORMAL_DEPTH)) g_first_hits[pixel] = first_hit;
+        if (g.aovs & AOV_ALBEDO)                          g_first_hit_albedo[pixel] = first_hit_albedo;
+        if (g.aovs & AOV_IDS)                             g_first_hit_ids   [pixel] = first_hit_id;
+    }
+    if (g.accumulator_count != 0 && !reprojected) {
+        // TODO: prevent floating-point accumulators from growing too large
+        count   = g_sample_counts[pixel];
+        history = count > 0 ? g_sample_accumulator[pixel] : 0; // pixels cleared by a coarse frame keep the sum of the previous image
+    }
+    accumulated_samples += history;
+
+    g_sample_counts     [pixel] = count + 1;
+    g_sample_accumulator[pixel] = accumulated_samples;
+
+    // calculate final pixel colour and write output values
+    float4 color = sqrt(accumulated_samples / (count+1) * float4(g.light_scale, 1)); // TODO: better gamma-correction
+    g_render_target[pixel] = color;
+
+    // reduced resolution frames fill the pixels of the block which have no samples of their own yet
+    // the first frame of an image clears them, to be traced by later, finer frames
+    if (g.render_scale > 1) {
+        uint2 block = dispatch_index()*g.render_scale;
+        for (uint y = 0; y < g.render_scale; y++) {
+            for (uint x = 0; x < g.render_scale; x++) {
+                uint2 block_pixel = block + uint2(x, y);
+                if (all(block_pixel == pixel)) continue;
+
+                if (g.accumulator_count == 0)         g_sample_counts[block_pixel] = 0;
+                if (g_sample_counts[block_pixel] == 0) {
+                    g_render_target[block_pixel] = color; // writes past the edges are discarded
+                    if (g.aovs & AOV_NORMAL_DEPTH) g_first_hits      [block_pixel] = first_hit;
+                    if (g.aovs & AOV_ALBEDO)       g_first_hit_albedo[block_pixel] = first_hit_albedo;
+                    if (g.aovs & AOV_IDS)          g_first_hit_ids   [block_pixel] = first_hit_id;
+                }
+            }
+        }
+    }
+}
+
+[shader("raygeneration")]
+void camera_rgen() {
     // accumulate new samples for this frame
     float4 accumulated_samples = 0;
+    float  luminance_squares   = 0;
 
+    RayDesc  first_ray;
+    FirstHit first_hit;
     for (uint sample_index = 0; sample_index < g.samples_per_pixel; sample_index++) {
-        // generate camera ray
-        ray.Origin = g.camera_to_world[3].xyz / g.camera_to_world[3].w;
-
-        ray.Direction.xy  = DispatchRaysIndex().xy + 0.5;                         // pixel centers
-        ray.Direction.xy += 0.5 * float2(random11(rng), random11(rng));           // random offset inside pixel
-        ray.Direction.xy  = 2*ray.Direction.xy / DispatchRaysDimensions().xy - 1; // normalize to clip coordinates
-        ray.Direction.x  *= g.camera_aspect;
-        ray.Direction.y  *= -1;
-        ray.Direction.z   = -g.camera_focal_length;
-        ray.Direction     = normalize(mul(float4(ray.Direction, 0), g.camera_to_world).xyz);
+        Sampler  rng = generate_pixel_sampler(traced_pixel(), sample_index);
+        RayDesc  ray = generate_camera_ray(rng);
+        FirstHit hit;
+        if (sample_index == 0) first_ray = ray; // trace_path_sample advances ray
+        float4 sample = trace_path_sample(rng, ray, hit);
+        if (sample_index == 0) first_hit = hit;
+
+        accumulated_samples += sample;
+        luminance_squares   += luminance(sample.rgb * g.light_scale) * luminance(sample.rgb * g.light_scale);
+    }
 
-        accumulated_samples += trace_path_sample(rng, ray);
+    // unbiased variance of this frame's samples of the pixel, as displayed
+    if (g.samples_per_pixel > 1) {
+        float n   = g.samples_per_pixel;
+        float sum = luminance(accumulated_samples.rgb * g.light_scale);
+        count_pixel_variance(max(0, luminance_squares - sum*sum/n) / (n - 1));
     }
     accumulated_samples /= g.samples_per_pixel;
-    // add previous frames' samples
-    if (g.accumulator_count != 0) {
-        // TODO: prevent floating-point accumulators from growing too large
-        accumulated_samples += g_sample_accumulator[DispatchRaysIndex().xy];
+    write_accumulated_samples(accumulated_samples, first_ray, first_hit);
+}
+
+// wavefront integrator
+// the host dispatches generate once per sample, then once per bounce trace and shade for each bin, and resolve once per frame
+// the trace dispatch only finds the next hit of each path in the trace queue, stores the surface resolved by its hit shader
+// and pushes the path into the bin of the hit's shader, or the miss bin. each bin's shade dispatch then runs a single
+// material over a dense batch of paths, shading the stored surfaces without tracing them again, except for translucent
+// hits with probe rays, which query the instance's own mesh through its hit shader. survivors are pushed back into the
+// trace queue. paths are neither split nor update the radiance cache or record guiding radiance, as camera paths do
+// the host sizes the trace and shade dispatches from the queue counts with ExecuteIndirect, clearing each count as it does
+
+void   shade_lambert    (inout RayPayload payload, SurfaceHit hit);
+void   shade_light      (inout RayPayload payload, SurfaceHit hit);
+void   shade_translucent(inout RayPayload payload, SurfaceHit hit, float3 diffuse_irradiance);
+void   shade_miss       (inout RayPayload payload);
+bool   gathers_translucent_irradiance(RayPayload payload);
+float3 gather_translucent_irradiance (SurfaceHit hit);
+
+inline uint path_queue_index(uint queue, uint slot) {
+    return queue*wf.paths_count + slot;
+}
+
+inline void path_queue_push(uint queue, uint path_id) {
+    uint slot;
+    InterlockedAdd(g_path_queue_counts[queue], 1, slot);
+    g_path_queues[path_queue_index(queue, slot)] = path_id;
+}
+
+inline uint linear_pixel_index() {
+    return DispatchRaysIndex().y*DispatchRaysDimensions().x + DispatchRaysIndex().x;
+}
+
+[shader("raygeneration")]
+void wavefront_generate_rgen() {
+    uint path_id = linear_pixel_index();
+
+    float4 radiance;
+    if (wf.sample_index == 0) radiance = 0;
+    else                      radiance = g_path_radiances[path_id];
+
+    Sampler rng = generate_pixel_sampler(traced_pixel(), wf.sample_index);
+    RayDesc ray = generate_camera_ray(rng);
+
+    g_path_origins    [path_id] = ray.Origin;
+    g_path_directions [path_id] = float4(ray.Direction, INFINITY);
+    g_path_throughputs[path_id] = float4(1, 1, 1, 0);
+    g_path_radiances  [path_id] = radiance;
+    g_path_rngs       [path_id] = rng;
+
+    path_queue_push(PATH_TRACE_QUEUE, path_id);
+}
+
+[shader("raygeneration")]
+void wavefront_trace_rgen() {
+    uint path_id = g_path_queues[path_queue_index(PATH_TRACE_QUEUE, DispatchRaysIndex().x)];
+
+    RayDesc ray;
+    ray.TMin      = 0.000001;
+    ray.TMax      = 10000;
+    ray.Origin    = g_path_origins   [path_id];
+    ray.Direction = g_path_directions[path_id].xyz;
+
+    RayPayload payload = (RayPayload) 0;
+    payload.rng    = sampler_init_random(0); // unused
+    payload.flags  = PAYLOAD_CLASSIFY;
+    payload.shader = PATH_MISS_QUEUE; // kept by the miss shader
+    payload.ids    = ~0;
+    count_rays();
+    TraceRay(
+        g_scene, RAY_FLAG_CULL_BACK_FACING_TRIANGLES, 0xff,
+        0, 1, 0,
+        ray, payload
+    );
+
+    g_path_directions[path_id].w = payload.t;
+    if (!isinf(payload.t)) {
+        PathHit hit;
+        hit.normal            = payload.normal;
+        hit.object_position   = payload.scatter;
+        hit.color             = payload.albedo;
+        hit.translucent_index = asuint(payload.pdf);
+        hit.ids               = payload.ids;
+        g_path_hits[path_id] = hit;
     }
+    path_queue_push(payload.shader, path_id);
+}
 
-    // calculate final pixel colour and write output values
-    g_render_target     [DispatchRaysIndex().xy] = sqrt(accumulated_samples / (g.accumulator_count+1)); // TODO: better gamma-correction
-    g_sample_accumulator[DispatchRaysIndex().xy] = accumulated_samples;
+[shader("raygeneration")]
+void wavefront_shade_rgen() {
+    uint path_id = g_path_queues[path_queue_index(wf.shader, DispatchRaysIndex().x)];
+
+    // load path state, with the distance to the hit found by the trace dispatch
+    float4 direction = g_path_directions[path_id];
+    float  t         = direction.w;
+
+    RayDesc ray;
+    ray.TMin      = 0.000001;
+    ray.TMax      = 10000;
+    ray.Origin    = g_path_origins[path_id];
+    ray.Direction = direction.xyz;
+
+    float4 throughput = g_path_throughputs[path_id];
+
+    PathState path   = path_init(g_path_rngs[path_id], ray);
+    path.throughput  = throughput.rgb;
+    path.scatter_pdf = throughput.a;
+    path.radiance    = g_path_radiances[path_id];
+
+    RayPayload payload = path_payload(path, wf.bounce_index, false);
+    if (wf.shader == Shader::Translucent && g.translucent_probes && gathers_translucent_irradiance(payload)) {
+        // probe rays need the hit shader's instance: trace again, through only the neighbourhood of the stored hit
+        ray.TMin = t*0.999;
+        ray.TMax = t*1.0001;
+        count_rays();
+        TraceRay(
+            g_scene, RAY_FLAG_CULL_BACK_FACING_TRIANGLES, 0xff,
+            0, 1, 0,
+            ray, payload
+        );
+    } else if (wf.shader == PATH_MISS_QUEUE) {
+        shade_miss(payload);
+    } else {
+        PathHit stored = g_path_hits[path_id];
+
+        SurfaceHit hit;
+        hit.t                 = t;
+        hit.direction         = ray.Direction;
+        hit.position          = ray.Origin + t*ray.Direction;
+        hit.normal            = stored.normal;
+        hit.object_position   = stored.object_position;
+        hit.color             = stored.color;
+        hit.translucent_index = stored.translucent_index;
+        hit.ids               = stored.ids;
+
+        switch (wf.shader) {
+            case Shader::Lambert: shade_lambert(payload, hit); break;
+            case Shader::Light:   shade_light  (payload, hit); break;
+            case Shader::Translucent: {
+                float3 diffuse_irradiance = gathers_translucent_irradiance(payload) ? gather_translucent_irradiance(hit) : 0;
+                shade_translucent(payload, hit, diffuse_irradiance);
+            } break;
+        }
+    }
+
+    if (scatter_path(path, wf.bounce_index, payload) && wf.bounce_index < g.bounces_per_sample) {
+        path_queue_push(PATH_TRACE_QUEUE, path_id);
+    }
+    if (wf.sample_index == 0 && wf.bounce_index == 0) g_path_first_hits[path_id] = path.first_hit;
+
+    // store path state
+    g_path_origins    [path_id] = path.ray.Origin;
+    g_path_directions [path_id] = float4(path.ray.Direction, INFINITY);
+    g_path_throughputs[path_id] = float4(path.throughput, path.scatter_pdf);
+    g_path_radiances  [path_id] = path.radiance;
+    g_path_rngs       [path_id] = path.rng;
+}
+
+[shader("raygeneration")]
+void wavefront_resolve_rgen() {
+    uint path_id = linear_pixel_index();
+
+    // the first sample's camera ray, as generated
+    Sampler rng = generate_pixel_sampler(traced_pixel(), 0);
+    RayDesc ray = generate_camera_ray(rng);
+    write_accumulated_samples(g_path_radiances[path_id] / g.samples_per_pixel, ray, g_path_first_hits[path_id]);
 }
 
 TriangleHitGroup lambert_hit_group = {
@@ -167,15 +1169,36 @@ TriangleHitGroup lambert_hit_group = {
     "lambert_chit"
 };
 
+void shade_lambert(inout RayPayload payload, SurfaceHit hit) {
+    uint guiding = guiding_node(hit.position, payload.flags);
+
+    float3 brdf = hit.color * MEAN_HEMISPHERE_COSINE / (TAU/2);
+
+    float3 direct_lighting = 0;
+    if (is_light_sampling_enabled() && payload.bounce_index < g.bounces_per_sample && !(payload.flags & PAYLOAD_SKIP_LIGHT_SAMPLING)) {
+        float3 light_direction;
+        direct_lighting = sample_direct_lighting(payload.rng, guiding, hit.position, hit.normal, light_direction) * brdf;
+    }
+
+    float  pdf;
+    float3 scatter = sample_scatter(payload.rng, guiding, hit.normal, pdf);
+
+    payload.scatter     = scatter;
+    payload.reflectance = brdf * safe_divide(max(0, dot(scatter, hit.normal)), pdf); // the cosine-weighted bsdf sample alone gives hit.color * MEAN_HEMISPHERE_COSINE
+    payload.emission    = direct_lighting;
+    payload.pdf         = pdf;
+    payload.normal      = hit.normal;
+    payload.albedo      = hit.color;
+    payload.t           = hit.t;
+    payload.shader      = Shader::Lambert;
+    write_hit_ids(payload, hit);
+}
+
 [shader("closesthit")]
 void lambert_chit(inout RayPayload payload, Attributes attr) {
-    uint3  indices = load_3x16bit_indices(l_indices, PrimitiveIndex());
-    float3 normal  = get_world_space_normal(indices, attr.barycentrics);
-
-    payload.scatter     = random_on_hemisphere(payload.rng, normal);
-    payload.reflectance = l.color * dot(normal, payload.scatter);
-    payload.emission    = 0;
-    payload.t           = RayTCurrent();
+    SurfaceHit hit = surface_hit(attr);
+    if (classify_hit(payload, Shader::Lambert, hit)) return;
+    shade_lambert(payload, hit);
 }
 
 TriangleHitGroup light_hit_group = {
@@ -183,29 +1206,43 @@ TriangleHitGroup light_hit_group = {
     "light_chit"
 };
 
-[shader("closesthit")]
-void light_chit(inout RayPayload payload, Attributes attr) {
-    uint3  indices = load_3x16bit_indices(l_indices, PrimitiveIndex());
-    float3 normal  = get_world_space_normal(indices, attr.barycentrics);
-
+void shade_light(inout RayPayload payload, SurfaceHit hit) {
     float3 color;
-    if (any(l.color)) color = l.color;
-    else              color = g.light_color;
+    if (any(hit.color)) color = hit.color;
+    else                color = g.light_color;
+
+    float light_cosine = -dot(hit.normal, hit.direction);
 
     payload.scatter     = 0;
     payload.reflectance = 0;
-    payload.emission    = color * -dot(normal, WorldRayDirection());
-    payload.t           = RayTCurrent();
+    payload.emission    = color * light_cosine;
+    payload.pdf         = light_sampling_pdf(hit.t, light_cosine);
+    payload.normal      = hit.normal;
+    payload.albedo      = 0;
+    payload.t           = hit.t;
+    payload.shader      = Shader::Light;
+    write_hit_ids(payload, hit);
 }
 
-[shader("miss")]
-void miss(inout RayPayload payload) {
+[shader("closesthit")]
+void light_chit(inout RayPayload payload, Attributes attr) {
+    SurfaceHit hit = surface_hit(attr);
+    if (classify_hit(payload, Shader::Light, hit)) return;
+    shade_light(payload, hit);
+}
+
+void shade_miss(inout RayPayload payload) {
     payload.scatter     = 0;
     payload.reflectance = 0;
     payload.emission    = 0;
     payload.t           = INFINITY;
 }
 
+[shader("miss")]
+void miss(inout RayPayload payload) {
+    shade_miss(payload);
+}
+
 // translucent materials
 
 float schlick(float refractive_index, float cosine) {
@@ -221,29 +1258,46 @@ float schlick(float refractive_index, float cosine) {
     return fresnel;
 }
 
+// running mean over the point's own updates, which differ in number between points while the collection is budgeted
+inline float4 accumulate_payload(float4 payload, float3 flux) {
+    payload.w   += 1;
+    payload.xyz += (flux - payload.xyz) / payload.w;
+    return payload;
+}
+
+// affine transform of a point (w = 1) or direction (w = 0) from the mesh's object space into the instance's world space
+inline float3 translucent_to_world(TranslucentProperties translucent, float3 v, float w) {
+    return v.x*translucent.object_to_world[0] + v.y*translucent.object_to_world[1] + v.z*translucent.object_to_world[2] + w*translucent.object_to_world[3];
+}
+
 [shader("raygeneration")]
-// x = sample point index
+// x = index in the window of sample points updated this frame
 // y = translucent_id + instance_id*translucent_instance_stride
 void translucent_rgen() {
     uint2 index = DispatchRaysIndex().xy;
     index.y = g_write_translucent_indices[index.y];
 
     // fetch sample point data
-    RWStructuredBuffer<SamplePoint> sample_points = g_write_translucent_samples[2*index.y + 0];
+    RWStructuredBuffer<float4> payloads = g_write_translucent_payloads[2*index.y + 0];
     {
         // TODO: don't discard shader threads
         uint samples_count, _stride;
-        sample_points.GetDimensions(samples_count, _stride);
-        if (index.x >= samples_count) return;
+        payloads.GetDimensions(samples_count, _stride);
+
+        // the window rotates through the points of instances with more points than it covers
+        uint window = DispatchRaysDimensions().x;
+        if (index.x >= min(window, samples_count)) return;
+        if (window < samples_count) index.x = (g.translucent_update_offset + index.x) % samples_count;
     }
-    TranslucentProperties translucent  = g_translucent_properties[index.y];
-    SamplePoint           sample_point = sample_points[index.x];
-    float3                normal       = g_point_normals[2*index.y + 1][index.x];
+    TranslucentProperties translucent = g_translucent_properties[index.y];
+    float3                position    = translucent_to_world(translucent, g_translucent_positions[2*index.y + 0][index.x], 1);
+    float3                normal      = normalize(translucent_to_world(translucent, g_point_normals[2*index.y + 1][index.x], 0));
+    float4                payload     = payloads[index.x];
 
-    if (g.translucent_accumulator_count == 0) sample_point.payload = 0;
+    if (g.translucent_accumulator_count == 0) payload = 0; // every point is updated after a reset
 
     // accumulate irradiance samples
-    uint rng = hash(uint3(index, g.frame_rng*(g.translucent_accumulator_count != 0)));
+    uint seed = hash(uint3(index, g.translucent_sampler_seed)); // camera resets keep the points' sequences
 
     RayDesc ray;
     ray.TMin = 0.0001;
@@ -251,17 +1305,237 @@ void translucent_rgen() {
 
     float3 transmitted_irradiance = 0;
     for (uint i = 0; i < g.samples_per_pixel; i++) {
-        ray.Origin    = sample_point.position;
-        ray.Direction = random_on_hemisphere(rng, normal); // TODO: cosine weighted samples
+        Sampler rng;
+        if (g.low_discrepancy_sampling) rng = sampler_init_sobol(seed, (uint) payload.w*g.samples_per_pixel + i, 0); // points are not arranged in screen space: no rotation
+        else                            rng = sampler_init_random(hash(uint4(index, g.frame_rng*(payload.w != 0), i)));
 
-        float3 radiance = trace_path_sample(rng, ray, IGNORE_TRANSLUCENT_EMISSION).rgb; // ignore translucent emission to prevent positive feedback
-        float  cosine   = -dot(ray.Direction, normal);
+        float3 direction = random_cosine_on_hemisphere(rng, normal);
+        ray.Origin    = position;
+        ray.Direction = direction;
+
+        FirstHit first_hit;
+        float3 radiance = trace_path_sample(rng, ray, first_hit, IGNORE_TRANSLUCENT_EMISSION).rgb; // ignore translucent emission to prevent positive feedback
+        float  cosine   = dot(direction, normal); // trace_path_sample advances ray: use the initial direction
         float  fresnel  = 1 - schlick(g.translucent_refractive_index, cosine);
 
-        transmitted_irradiance += radiance * cosine * fresnel;
+        transmitted_irradiance += radiance * fresnel * MEAN_HEMISPHERE_COSINE;
+    }
+    float3 flux = (transmitted_irradiance * translucent.samples_mean_area) / (TAU/2 * g.samples_per_pixel);
+    payloads[index.x] = accumulate_payload(payload, flux);
+}
+
+[shader("raygeneration")]
+// x = node index within refit.level
+// y = translucent instance, as in translucent_rgen
+void translucent_refit_rgen() {
+    uint2 index = DispatchRaysIndex().xy;
+    index.y = g_write_translucent_indices[index.y];
+
+    TranslucentProperties translucent = g_translucent_properties[index.y];
+    if (refit.level >= translucent.octree_levels_count) return;
+
+    uint node_index = translucent.octree_level_offsets[refit.level] + index.x;
+    if (node_index >= translucent.octree_level_offsets[refit.level + 1]) return;
+
+    // the level below has been refit by the previous dispatch
+    TranslucentNode node = g_translucent_nodes[translucent.nodes_offset + node_index];
+    float3          flux = 0;
+    if (node.leaf) {
+        StructuredBuffer<float4> payloads = g_translucent_payloads[2*index.y + 1];
+        for (uint i = 0; i < node.count; i++) flux += payloads[g_translucent_point_indices[translucent.point_indices_offset + node.first + i]].xyz;
+    } else {
+        for (uint i = 0; i < node.count; i++) flux += g_translucent_node_flux[translucent.node_flux_offset + node.first + i];
     }
-    sample_point.payload += (transmitted_irradiance * translucent.samples_mean_area) / (TAU/2 * g.samples_per_pixel);
-    sample_points[index.x] = sample_point;
+    g_translucent_node_flux[translucent.node_flux_offset + node_index] = flux;
+}
+
+// shared exponent encoding of nonnegative colors, 9 bits of mantissa per channel and a 5 bit exponent
+// as Translucent::encode_rgb9e5 and Translucent::decode_rgb9e5
+uint encode_rgb9e5(float3 rgb) {
+    rgb = clamp(rgb, 0, RGB9E5_MAX);
+    float max_channel = max(rgb.r, max(rgb.g, rgb.b));
+
+    int   exponent = (int) max(-16, floor(log2(max_channel))) + 16; // biased by 15, of the mantissa's top bit
+    float scale    = exp2(exponent - 15 - 9);
+    if (floor(max_channel / scale + 0.5) == 512) { // rounded up into the next exponent
+        exponent += 1;
+        scale    *= 2;
+    }
+    uint3 mantissa = (uint3) floor(rgb / scale + 0.5);
+    return mantissa.r | mantissa.g << 9 | mantissa.b << 18 | (uint) exponent << 27;
+}
+
+float3 decode_rgb9e5(uint encoded) {
+    float scale = exp2((int) (encoded >> 27) - 15 - 9);
+    return float3(encoded & 511, (encoded >> 9) & 511, (encoded >> 18) & 511) * scale;
+}
+
+// as Translucent::decode_position
+float3 load_grid_position(TranslucentProperties translucent, uint i) {
+    if (!g.translucent_compact_samples) return asfloat(g_translucent_grid_positions.Load3(12*i));
+
+    const uint max_value = (1u << TRANSLUCENT_POSITION_BITS) - 1;
+    uint2  encoded = g_translucent_grid_positions.Load2(8*i);
+    uint3  q       = uint3(encoded.x, encoded.x >> 21 | encoded.y << 11, encoded.y >> 10) & max_value;
+    return translucent.grid_origin + q * (translucent.grid_cell_size / max_value) * translucent.grid_dimensions;
+}
+
+// i in the instance's range of the grid payloads
+float3 load_grid_payload(uint i) {
+    if (!g.translucent_compact_samples) return asfloat(g_translucent_grid_payloads.Load3(12*i));
+    return decode_rgb9e5(g_translucent_grid_payloads.Load(4*i));
+}
+
+[shader("raygeneration")]
+// x = index in grid order
+// y = translucent instance, as in translucent_rgen
+void translucent_permute_rgen() {
+    uint2 index = DispatchRaysIndex().xy;
+    index.y = g_write_translucent_indices[index.y];
+
+    StructuredBuffer<float4> payloads = g_translucent_payloads[2*index.y + 1];
+    uint samples_count, _stride;
+    payloads.GetDimensions(samples_count, _stride);
+    if (index.x >= samples_count) return;
+
+    TranslucentProperties translucent = g_translucent_properties[index.y];
+    if (translucent.grid_cell_size == 0) return;
+
+    uint   i       = translucent.grid_payloads_offset + index.x;
+    float3 payload = payloads[g_translucent_grid_point_indices[translucent.grid_point_indices_offset + index.x]].xyz;
+    if (g.translucent_compact_samples) g_translucent_grid_payloads.Store(4*i, encode_rgb9e5(payload));
+    else                               g_translucent_grid_payloads.Store3(12*i, asuint(payload));
+}
+
+// photon shooting
+// instead of tracing paths from every sample point, photons are emitted from the emitters and traced through the scene,
+// depositing their transmitted flux onto the nearest sample point of each translucent surface they hit, after
+// Jensen and Buhler 2002. the deposits of a frame are resolved into one update of every sample point's payload
+
+float3 eval_brdf(uint shader, float3 albedo, float3 normal, float3 light_direction);
+
+inline void interlocked_add_float(uint address, float value) {
+    if (value == 0) return;
+
+    uint expected = g_translucent_photon_flux.Load(address);
+    while (true) {
+        uint original;
+        g_translucent_photon_flux.InterlockedCompareExchange(address, expected, asuint(asfloat(expected) + value), original);
+        if (original == expected) break;
+        expected = original;
+    }
+}
+
+// hit_point is in the mesh's object space, whose grid cells are searched around it
+void deposit_translucent_photon(TranslucentProperties translucent, float3 hit_point, float3 flux) {
+    if (translucent.grid_cell_size == 0) return;
+
+    int3 cell  = (int3) floor((hit_point - translucent.grid_origin) / translucent.grid_cell_size);
+    int3 lower = max(0,                                      cell - 1);
+    int3 upper = min((int3) translucent.grid_dimensions - 1, cell + 1);
+
+    uint  nearest          = ~0;
+    float nearest_distance = INFINITY;
+    for (int z = lower.z; z <= upper.z; z++) {
+        for (int y = lower.y; y <= upper.y; y++) {
+            uint row   = translucent.grid_cells_offset + (z*translucent.grid_dimensions.y + y)*translucent.grid_dimensions.x;
+            uint first = g_translucent_grid_cells[row + lower.x];
+            uint end   = g_translucent_grid_cells[row + upper.x + 1];
+            for (uint i = first; i < end; i++) {
+                float distance = length(load_grid_position(translucent, translucent.grid_point_indices_offset + i) - hit_point);
+                if (distance < nearest_distance) {
+                    nearest_distance = distance;
+                    nearest          = i;
+                }
+            }
+        }
+    }
+    if (nearest == ~0) return;
+
+    // the flux through the point's area is its irradiance times its area, scaled as in translucent_rgen
+    float3 payload = flux * MEAN_HEMISPHERE_COSINE / ((TAU/2)*(TAU/2));
+    uint   address = 12*(translucent.grid_payloads_offset + nearest);
+    interlocked_add_float(address + 0, payload.x);
+    interlocked_add_float(address + 4, payload.y);
+    interlocked_add_float(address + 8, payload.z);
+}
+
+[shader("raygeneration")]
+// x = photon index
+void translucent_photon_rgen() {
+    if (g.emitters_count == 0) return;
+
+    // photons of consecutive frames continue one sequence while translucent samples accumulate
+    uint    index = DispatchRaysIndex().x;
+    Sampler rng;
+    if (g.low_discrepancy_sampling) rng = sampler_init_sobol(g.translucent_sampler_seed, g.translucent_accumulator_count*DispatchRaysDimensions().x + index, 0); // photons are not arranged in screen space: no rotation
+    else                            rng = sampler_init_random(hash(uint2(index, g.frame_rng)));
+
+    // emit from a uniform point on the emitters in a cosine-weighted direction, as trace_light_subpath
+    float3 light_point;
+    EmitterTriangle emitter = sample_emitter(rng, light_point);
+
+    RayDesc ray;
+    ray.TMin      = 0.0001;
+    ray.TMax      = 10000;
+    ray.Origin    = light_point;
+    ray.Direction = random_cosine_on_hemisphere(rng, emitter.normal);
+
+    float  light_cosine = dot(ray.Direction, emitter.normal);
+    float  emission_pdf = light_cosine / (TAU/2) / g.emitters_total_area;
+    float3 flux         = get_emitter_color(emitter) * light_cosine * light_cosine / emission_pdf / DispatchRaysDimensions().x; // emission matches light_chit
+
+    // as many segments as the paths of translucent_rgen from a sample point to the emitters
+    for (uint path_length = 1; path_length <= g.bounces_per_sample + 1; path_length++) {
+        RayPayload hit;
+        hit.rng          = rng;
+        hit.bounce_index = path_length;
+        hit.flags        = PAYLOAD_DEPOSIT_PHOTON | PAYLOAD_IGNORE_TRANSLUCENT_EMISSION | PAYLOAD_SKIP_LIGHT_SAMPLING | PAYLOAD_SKIP_GUIDING;
+        hit.emission     = flux;
+        hit.shader       = Shader::Count;
+        count_rays();
+        TraceRay(
+            g_scene, RAY_FLAG_CULL_BACK_FACING_TRIANGLES, 0xff,
+            0, 1, 0,
+            ray, hit
+        );
+        rng = hit.rng;
+        if (isinf(hit.t) || hit.shader == Shader::Light) break;
+
+        // scatter along the direction sampled by the hit shader, with the brdf of light arriving along the ray
+        float scatter_cosine = dot(hit.scatter, hit.normal);
+        if (hit.pdf <= 0 || scatter_cosine <= 0) break;
+        flux *= eval_brdf(hit.shader, hit.albedo, hit.normal, -ray.Direction) * scatter_cosine / hit.pdf;
+
+        ray.Origin    = ray.Origin + hit.t*ray.Direction;
+        ray.Direction = hit.scatter;
+    }
+}
+
+[shader("raygeneration")]
+// x = index in grid order
+// y = translucent instance, as in translucent_rgen
+void translucent_photon_resolve_rgen() {
+    uint2 index = DispatchRaysIndex().xy;
+    index.y = g_write_translucent_indices[index.y];
+
+    RWStructuredBuffer<float4> payloads = g_write_translucent_payloads[2*index.y + 0];
+    uint samples_count, _stride;
+    payloads.GetDimensions(samples_count, _stride);
+    if (index.x >= samples_count) return;
+
+    TranslucentProperties translucent = g_translucent_properties[index.y];
+    if (translucent.grid_cell_size == 0) return;
+
+    // take the frame's deposits, leaving the buffer cleared for the next frame
+    uint   address = 12*(translucent.grid_payloads_offset + index.x);
+    float3 flux    = asfloat(g_translucent_photon_flux.Load3(address));
+    g_translucent_photon_flux.Store3(address, 0);
+
+    uint   point_index = g_translucent_grid_point_indices[translucent.grid_point_indices_offset + index.x];
+    float4 payload     = payloads[point_index];
+    if (g.translucent_accumulator_count == 0) payload = 0;
+    payloads[point_index] = accumulate_payload(payload, flux);
 }
 
 TriangleHitGroup translucent_hit_group = {
@@ -300,52 +1574,548 @@ inline float3 eval_bssrdf_dipole(TranslucentProperties translucent, float radius
     return max(0, albedo/(2*TAU) * (m_real + m_virtual));
 }
 
-void debug_draw_translucent_samples(inout RayPayload payload, Attributes attr);
+// linearly interpolated, indexed by the square root of the radius to resolve the peak at 0
+inline float3 eval_bssrdf_dipole_lut(float radius) {
+    float u = sqrt(radius / g.translucent_dipole_lut_radius) * (TRANSLUCENT_DIPOLE_LUT_SIZE - 1);
+    if (u >= TRANSLUCENT_DIPOLE_LUT_SIZE - 1) return 0; // below TRANSLUCENT_DIPOLE_LUT_TOLERANCE of the peak
 
-#define TRANSLUCENT_INIT() \
-    uint index = l.translucent_id * g.translucent_instance_stride + InstanceID(); \
-    TranslucentProperties         translucent   = g_translucent_properties[index]; \
-    StructuredBuffer<SamplePoint> samples       = g_translucent_samples[index]; \
-    uint samples_count, _stride; samples.GetDimensions(samples_count, _stride); \
+    uint i = (uint) u;
+    return lerp(g_dipole_lut[i], g_dipole_lut[i + 1], u - i);
+}
 
-[shader("closesthit")]
-void translucent_chit(inout RayPayload payload, Attributes attr) {
-    // debug_draw_translucent_samples(payload, attr); return; // debug visualisation of sample points
-    TRANSLUCENT_INIT();
+inline float3 eval_bssrdf(TranslucentProperties translucent, float radius) {
+    if (g.translucent_bssrdf_scale)      return eval_bssrdf_tabulated(translucent, radius);
+    if (g.translucent_dipole_lut_radius) return eval_bssrdf_dipole_lut(radius);
+    else                                 return eval_bssrdf_dipole(translucent, radius);
+}
 
-    uint3  indices = load_3x16bit_indices(l_indices, PrimitiveIndex());
-    float3 normal  = get_world_space_normal(indices, attr.barycentrics);
-    // calculated in model space to match sample points
-    float3 hit_point = WorldRayOrigin() + RayTCurrent() * WorldRayDirection();
+// sum of the bssrdf-weighted payloads of the sample points around hit_point
+// clusters of the octree are evaluated as a single point at their centroid once their area subtends less than
+// g.translucent_octree_error of solid angle, after Jensen and Buhler 2002
+// the grid and the octree neglect sample points beyond g.translucent_cutoff_radius, the grid visiting only the cells in range
+// hit_point and the sample points are in the mesh's object space, distances are scaled into the instance's world space
+float3 gather_translucent_samples(TranslucentProperties translucent, StructuredBuffer<float3> positions, StructuredBuffer<float4> payloads, uint samples_count, float3 hit_point) {
+    float scale  = translucent.scale;
+    float cutoff = g.translucent_cutoff_radius / scale;
+
+    float3 sum = 0;
+    if (g.translucent_octree_error <= 0 && cutoff > 0 && translucent.grid_cell_size > 0) {
+        int3 lower = max(0,                                    (int3) floor((hit_point - cutoff - translucent.grid_origin) / translucent.grid_cell_size));
+        int3 upper = min((int3) translucent.grid_dimensions - 1, (int3) floor((hit_point + cutoff - translucent.grid_origin) / translucent.grid_cell_size));
+        if (any(lower > upper)) return 0;
+
+        for (int z = lower.z; z <= upper.z; z++) {
+            for (int y = lower.y; y <= upper.y; y++) {
+                // the cells along x are contiguous
+                uint row   = translucent.grid_cells_offset + (z*translucent.grid_dimensions.y + y)*translucent.grid_dimensions.x;
+                uint first = g_translucent_grid_cells[row + lower.x];
+                uint end   = g_translucent_grid_cells[row + upper.x + 1];
+                for (uint i = first; i < end; i++) {
+                    float radius = length(load_grid_position(translucent, translucent.grid_point_indices_offset + i) - hit_point);
+                    if (radius < cutoff) sum += eval_bssrdf(translucent, scale*radius) * load_grid_payload(translucent.grid_payloads_offset + i);
+                }
+            }
+        }
+        return sum;
+    }
+    if (g.translucent_octree_error <= 0 || translucent.octree_levels_count == 0) {
+        for (uint i = 0; i < samples_count; i++) {
+            sum += eval_bssrdf(translucent, scale*length(positions[i] - hit_point)) * payloads[i].xyz;
+        }
+        return sum;
+    }
 
-    float3 diffuse_irradiance = 0;
-    if (payload.t <= g.translucent_emission_bounces && g.translucent_bssrdf_fudge) {
-        for (int i = 0; i < samples_count; i++) {
-            SamplePoint sample_point = samples[i];
-            float radius = length(sample_point.position - hit_point);
-            float3 bssrdf;
-            if (g.translucent_bssrdf_scale) bssrdf = eval_bssrdf_tabulated(translucent, radius);
-            else                            bssrdf = eval_bssrdf_dipole(translucent, radius);
-
-            diffuse_irradiance += bssrdf * sample_point.payload;
+    uint stack[TRANSLUCENT_OCTREE_STACK_SIZE];
+    uint stack_size = 0;
+    stack[stack_size++] = 0;
+    while (stack_size > 0) {
+        uint            node_index = stack[--stack_size];
+        TranslucentNode node       = g_translucent_nodes[translucent.nodes_offset + node_index];
+
+        // the subtended solid angle is independent of the scale
+        float distance = length(node.centroid - hit_point);
+        if (cutoff > 0 && distance - node.radius > cutoff) continue;
+
+        if (distance > node.radius && node.area < g.translucent_octree_error * distance*distance) {
+            sum += eval_bssrdf(translucent, scale*distance) * g_translucent_node_flux[translucent.node_flux_offset + node_index];
+        } else if (node.leaf) {
+            for (uint i = 0; i < node.count; i++) {
+                uint j = g_translucent_point_indices[translucent.point_indices_offset + node.first + i];
+                sum += eval_bssrdf(translucent, scale*length(positions[j] - hit_point)) * payloads[j].xyz;
+            }
+        } else {
+            for (uint i = 0; i < node.count; i++) stack[stack_size++] = node.first + i;
         }
-        diffuse_irradiance /= (g.translucent_accumulator_count + 1);
     }
+    return sum;
+}
+
+// bssrdf importance sampling with probe rays, after King et al. 2013, "BSSRDF Importance Sampling"
+// exit points are sampled on a disk around the hit point, perpendicular to the normal or one of the tangents, at an
+// exponential radius of one channel's effective attenuation, and projected onto the surface of the same geometry by a
+// probe ray through the disk. the irradiance at the exit point is estimated by one light sample, so unlike the sample
+// points only direct light is scattered below the surface: the two modes converge to different images
+// the probes draw from their own stream, so that the path's sampler advances by the same dimensions with or without them
+
+#define TRANSLUCENT_PROBE_AXIS_NORMAL 0.5 // probability of the disk perpendicular to the normal, the tangents share the rest
+
+// attenuation of the sampled radii per channel, of the dipole or spanning the tabulated profile
+inline float3 translucent_probe_attenuation() {
+    if (g.translucent_bssrdf_scale) return 4 / g.translucent_bssrdf_scale;
+    return max(sqrt(3 * g.translucent_scattering * g.translucent_absorption), 0.0001);
+}
+
+inline float translucent_probe_max_radius(float3 attenuation) {
+    if (g.translucent_probe_radius > 0) return g.translucent_probe_radius;
+    return 16 / min(attenuation.r, min(attenuation.g, attenuation.b)); // the profile vanishes
+}
+
+// area pdf of sampling `offset` on the disk perpendicular to `axis`, summed over the channels
+inline float translucent_probe_disk_pdf(float3 offset, float3 axis, float3 attenuation, float max_radius) {
+    float  radius = length(offset - dot(offset, axis)*axis);
+    float3 radial = attenuation * exp(-attenuation*radius) / (1 - exp(-attenuation*max_radius)); // truncated exponential
+    return radius < max_radius ? dot(radial, 1.0/3) / (TAU*max(radius, 0.0001)) : 0;
+}
+
+float3 probe_translucent_irradiance(inout Sampler rng, TranslucentProperties translucent, float3 hit_point, float3 normal) {
+    if (g.emitters_count == 0) return 0;
+
+    // orthonormal basis, after Duff et al. 2017, "Building an Orthonormal Basis, Revisited"
+    float  s         = normal.z >= 0 ? 1 : -1;
+    float  a         = -1 / (s + normal.z);
+    float  b         = normal.x * normal.y * a;
+    float3 tangent   = float3(1 + s*normal.x*normal.x*a, s*b, -s*normal.x);
+    float3 bitangent = float3(b, s + normal.y*normal.y*a, -normal.y);
+    float3 axes[3]   = { normal, tangent, bitangent };
+    float  axis_probabilities[3] = { TRANSLUCENT_PROBE_AXIS_NORMAL, (1 - TRANSLUCENT_PROBE_AXIS_NORMAL)/2, (1 - TRANSLUCENT_PROBE_AXIS_NORMAL)/2 };
+
+    float3 attenuation = translucent_probe_attenuation();
+    float  max_radius  = translucent_probe_max_radius(attenuation);
+
+    float3 sum = 0;
+    for (uint probe = 0; probe < g.translucent_probes; probe++) {
+        // pick the disk's axis and the channel of its radius
+        float u    = random01(rng);
+        uint  axis = u < axis_probabilities[0] ? 0 : (u < axis_probabilities[0] + axis_probabilities[1] ? 1 : 2);
+        uint  channel     = min((uint) (random01(rng) * 3), 2);
+        float attenuation_c = attenuation[channel];
+
+        float radius = -log(1 - random01(rng)*(1 - exp(-attenuation_c*max_radius))) / attenuation_c;
+        float phi    = TAU * random01(rng);
+        float height = sqrt(max(0, max_radius*max_radius - radius*radius));
+
+        float3 w = axes[axis];
+        float3 v = axes[(axis + 1) % 3];
+        float3 t = axes[(axis + 2) % 3];
+
+        RayDesc ray;
+        ray.Origin    = hit_point + radius*(cos(phi)*v + sin(phi)*t) + height*w;
+        ray.Direction = -w;
+        ray.TMin      = 0;
+        ray.TMax      = 2*height;
+
+        // pick one of the probe's intersections with this geometry uniformly, as a reservoir of the candidates
+        RayQuery<RAY_FLAG_FORCE_NON_OPAQUE> query;
+        query.TraceRayInline(g_scene, RAY_FLAG_NONE, 0xff, ray);
+        count_rays();
+
+        uint   hits_count = 0;
+        float  exit_t     = 0;
+        uint   exit_primitive    = 0;
+        float2 exit_barycentrics = 0;
+        while (query.Proceed()) {
+            if (query.CandidateInstanceIndex() != InstanceIndex() || query.CandidateGeometryIndex() != GeometryIndex()) continue;
+
+            hits_count += 1;
+            if (random01(rng) * hits_count < 1) {
+                exit_t            = query.CandidateTriangleRayT();
+                exit_primitive    = query.CandidatePrimitiveIndex();
+                exit_barycentrics = query.CandidateTriangleBarycentrics();
+            }
+        }
+        if (hits_count == 0) continue;
+
+        float3 exit_point  = ray.Origin + exit_t*ray.Direction;
+        float3 exit_normal = get_interpolated_normal(load_triangle_vertices(l_vertices, load_3x16bit_indices(l_indices, exit_primitive)), exit_barycentrics);
+        exit_normal = normalize(mul(float4(exit_normal, 0), ObjectToWorld4x3()));
+
+        // one-sample mis over the axes and channels, each disk's pdf projected onto the surface
+        float3 offset = exit_point - hit_point;
+        float  pdf    = 0;
+        for (uint i = 0; i < 3; i++) {
+            pdf += axis_probabilities[i] * translucent_probe_disk_pdf(offset, axes[i], attenuation, max_radius) * abs(dot(exit_normal, axes[i]));
+        }
+        if (pdf <= 0) continue;
+
+        // irradiance transmitted at the exit point from one light sample, without mis as no path continues from there
+        float3 light_point;
+        EmitterTriangle emitter = sample_emitter(rng, light_point);
+
+        float3 light_offset    = light_point - exit_point;
+        float  light_distance  = length(light_offset);
+        float3 light_direction = light_offset / light_distance;
+
+        float surface_cosine = dot(exit_normal, light_direction);
+        float light_cosine   = -dot(emitter.normal, light_direction);
+        if (surface_cosine <= 0 || light_cosine <= 0) continue;
+        if (!is_visible(exit_point, light_direction, light_distance)) continue;
+
+        float3 irradiance  = get_emitter_color(emitter) * light_cosine * surface_cosine / light_sampling_pdf(light_distance, light_cosine); // emission matches light_chit
+        float3 transmitted = irradiance * (1 - schlick(g.translucent_refractive_index, surface_cosine));
+
+        // scaled as the payloads of translucent_rgen, per unit area
+        sum += eval_bssrdf(translucent, length(offset)) * transmitted * MEAN_HEMISPHERE_COSINE / ((TAU/2)*(TAU/2)) * hits_count / pdf;
+    }
+    return sum / max(g.translucent_probes, 1);
+}
+
+void debug_draw_translucent_samples(inout RayPayload payload, Attributes attr);
+
+#define TRANSLUCENT_INIT_AT(translucent_index) \
+    uint index = translucent_index; \
+    TranslucentProperties    translucent = g_translucent_properties[index]; \
+    StructuredBuffer<float3> positions   = g_translucent_positions[NonUniformResourceIndex(2*index + 0)]; \
+    StructuredBuffer<float4> payloads    = g_translucent_payloads[NonUniformResourceIndex(2*index + 1)]; \
+    uint samples_count, _stride; positions.GetDimensions(samples_count, _stride); \
+
+#define TRANSLUCENT_INIT() TRANSLUCENT_INIT_AT(l.translucent_id * g.translucent_instance_stride + InstanceID())
+
+// whether translucent hits of the payload's ray add the subsurface irradiance
+bool gathers_translucent_irradiance(RayPayload payload) {
+    return payload.bounce_index <= g.translucent_emission_bounces && !(payload.flags & PAYLOAD_IGNORE_TRANSLUCENT_EMISSION) && g.translucent_bssrdf_fudge;
+}
+
+// subsurface irradiance gathered from the instance's sample points, in object space to match them
+float3 gather_translucent_irradiance(SurfaceHit hit) {
+    TRANSLUCENT_INIT_AT(hit.translucent_index);
+    return gather_translucent_samples(translucent, positions, payloads, samples_count, hit.object_position);
+}
+
+void shade_translucent(inout RayPayload payload, SurfaceHit hit, float3 diffuse_irradiance) {
+    float3 normal = hit.normal;
+
+    if (payload.flags & PAYLOAD_DEPOSIT_PHOTON) {
+        float cosine = -dot(hit.direction, normal);
+        deposit_translucent_photon(g_translucent_properties[hit.translucent_index], hit.object_position, payload.emission * (1 - schlick(g.translucent_refractive_index, cosine)));
+    }
+
+    uint   guiding = guiding_node(hit.position, payload.flags);
+    float3 brdf    = hit.color * MEAN_HEMISPHERE_COSINE / (TAU/2);
 
     float  n = g.translucent_refractive_index;
-    float3 scatter = random_on_hemisphere(payload.rng, normal);
-    float  lambert = dot(scatter, normal);
+    float  pdf;
+    float3 scatter = sample_scatter(payload.rng, guiding, normal, pdf);
 
-    float  incident_cosine     = lambert; // = dot(scatter, normal);
+    float  incident_cosine     = dot(scatter, normal);
     float  incident_fresnel    = schlick(n, incident_cosine);                          // boundary n1=1, n2>1; reflected component
 
-    float  transmitted_cosine  = sqrt(1 - 1/(n*n)*(1 - -dot(WorldRayDirection(), normal))); // nested identity: cos(asin(x)) = sin(acos(x)) = sqrt(1-x^2)
+    float  transmitted_cosine  = sqrt(1 - 1/(n*n)*(1 - -dot(hit.direction, normal))); // nested identity: cos(asin(x)) = sin(acos(x)) = sqrt(1-x^2)
     float  transmitted_fresnel = 1 - schlick(n, transmitted_cosine);                   // boundary n1>1, n2=1; transmitted component
 
+    float3 direct_lighting = 0;
+    if (is_light_sampling_enabled() && payload.bounce_index < g.bounces_per_sample && !(payload.flags & PAYLOAD_SKIP_LIGHT_SAMPLING)) {
+        float3 light_direction;
+        float3 incident_radiance = sample_direct_lighting(payload.rng, guiding, hit.position, normal, light_direction);
+        direct_lighting = incident_radiance * brdf * schlick(n, dot(light_direction, normal));
+    }
+
     payload.scatter     = scatter;
-    payload.reflectance = l.color * lambert * incident_fresnel;
-    payload.emission    = diffuse_irradiance * transmitted_fresnel / (TAU/2);
-    payload.t           = RayTCurrent();
+    payload.reflectance = brdf * incident_fresnel * safe_divide(max(0, incident_cosine), pdf);
+    payload.emission    = diffuse_irradiance * transmitted_fresnel / (TAU/2) + direct_lighting;
+    payload.pdf         = pdf;
+    payload.normal      = normal;
+    payload.albedo      = hit.color;
+    payload.t           = hit.t;
+    payload.shader      = Shader::Translucent;
+    write_hit_ids(payload, hit);
+}
+
+[shader("closesthit")]
+void translucent_chit(inout RayPayload payload, Attributes attr) {
+    SurfaceHit hit = surface_hit(attr);
+    if (classify_hit(payload, Shader::Translucent, hit)) return;
+
+    // debug_draw_translucent_samples(payload, attr); return; // debug visualisation of sample points
+
+    float3 diffuse_irradiance = 0;
+    if (gathers_translucent_irradiance(payload)) {
+        if (g.translucent_probes) {
+            Sampler probe_rng = sampler_init_random(hash(uint4(payload.rng.seed, payload.rng.index, payload.rng.dimension, payload.bounce_index)));
+            diffuse_irradiance = probe_translucent_irradiance(probe_rng, g_translucent_properties[hit.translucent_index], hit.position, hit.normal);
+        } else {
+            diffuse_irradiance = gather_translucent_irradiance(hit);
+        }
+    }
+    shade_translucent(payload, hit, diffuse_irradiance);
+}
+
+// bidirectional path tracing
+// each camera sample traces its own light subpath, then connects every camera vertex to the emitters (s = 1) and to
+// every light vertex (s > 1); hitting an emitter covers s = 0. strategies which connect light vertices to the camera
+// would splat to other pixels and are left out, both from the estimate and from the mis weights.
+// mis weights use the recursive partial sums of Georgiev 2012, "Implementing Vertex Connection and Merging".
+
+#define BDPT_MAX_LIGHT_VERTICES 8
+
+struct BdptVertex {
+    float3 position;
+    float3 normal;
+    float3 albedo;
+    float3 throughput;
+    float3 incident;    // towards the previous vertex on the light subpath
+    uint   shader;
+    uint   path_length; // segments from the emitter
+    float  dvcm;
+    float  dvc;
+};
+
+inline float mis_power(float x) { return x*x; }
+
+// brdf of the scattering materials; `light_direction` points towards the light side of the path
+// translucent reflection is weighted by the fresnel term of the light side only, as in translucent_chit
+float3 eval_brdf(uint shader, float3 albedo, float3 normal, float3 light_direction) {
+    float3 brdf = albedo * MEAN_HEMISPHERE_COSINE / (TAU/2);
+    if (shader == Shader::Translucent) brdf *= schlick(g.translucent_refractive_index, dot(light_direction, normal));
+    return brdf;
+}
+
+RayPayload trace_bdpt_segment(inout Sampler rng, RayDesc ray, uint bounce_index, uint flags) {
+    RayPayload payload;
+    payload.rng          = rng;
+    payload.bounce_index = bounce_index;
+    payload.flags        = flags | PAYLOAD_SKIP_LIGHT_SAMPLING | PAYLOAD_SKIP_GUIDING; // connections are made in the ray generation shader, whose mis weights assume bsdf sampling
+    payload.shader       = Shader::Count;
+    payload.ids          = ~0;
+    count_rays();
+    TraceRay(
+        g_scene, RAY_FLAG_CULL_BACK_FACING_TRIANGLES, 0xff,
+        0, 1, 0,
+        ray, payload
+    );
+    rng = payload.rng;
+    return payload;
+}
+
+uint trace_light_subpath(inout Sampler rng, uint max_path_length, out BdptVertex vertices[BDPT_MAX_LIGHT_VERTICES]) {
+    uint vertices_count = 0;
+    if (g.emitters_count == 0) return 0;
+
+    // emit from a uniform point on the emitters in a cosine-weighted direction
+    float3 light_point;
+    EmitterTriangle emitter = sample_emitter(rng, light_point);
+
+    RayDesc ray;
+    ray.TMin      = 0.0001;
+    ray.TMax      = 10000;
+    ray.Origin    = light_point;
+    ray.Direction = random_cosine_on_hemisphere(rng, emitter.normal);
+
+    float light_cosine   = dot(ray.Direction, emitter.normal);
+    float direct_pdf     = 1 / g.emitters_total_area;
+    float emission_pdf   = direct_pdf * light_cosine / (TAU/2);
+    float3 throughput    = get_emitter_color(emitter) * light_cosine * light_cosine / emission_pdf; // emission matches light_chit
+
+    float dvcm = mis_power(direct_pdf / emission_pdf);
+    float dvc  = mis_power(light_cosine / emission_pdf);
+
+    for (uint path_length = 1; vertices_count < BDPT_MAX_LIGHT_VERTICES; path_length++) {
+        rng.dimension = SAMPLER_CAMERA_DIMENSIONS + path_length*SAMPLER_BOUNCE_DIMENSIONS;
+        RayPayload hit = trace_bdpt_segment(rng, ray, path_length, PAYLOAD_IGNORE_TRANSLUCENT_EMISSION);
+        if (isinf(hit.t) || hit.shader == Shader::Light) break;
+
+        float incident_cosine = -dot(hit.normal, ray.Direction);
+        dvcm *= mis_power(hit.t*hit.t);
+        dvcm /= mis_power(incident_cosine);
+        dvc  /= mis_power(incident_cosine);
+
+        BdptVertex vertex;
+        vertex.position    = ray.Origin + hit.t*ray.Direction;
+        vertex.normal      = hit.normal;
+        vertex.albedo      = hit.albedo;
+        vertex.throughput  = throughput;
+        vertex.incident    = -ray.Direction;
+        vertex.shader      = hit.shader;
+        vertex.path_length = path_length;
+        vertex.dvcm        = dvcm;
+        vertex.dvc         = dvc;
+        vertices[vertices_count] = vertex;
+        vertices_count += 1;
+
+        if (path_length + 2 > max_path_length) break; // too long to connect to any further camera vertex
+
+        // scatter along the direction sampled by the hit shader
+        float scatter_cosine = dot(hit.scatter, hit.normal);
+        float scatter_pdf    = hit.pdf;
+        float reverse_pdf    = incident_cosine / (TAU/2);
+        if (scatter_pdf <= 0) break;
+
+        throughput *= eval_brdf(hit.shader, hit.albedo, hit.normal, vertex.incident) * scatter_cosine / scatter_pdf;
+        dvc  = mis_power(scatter_cosine / scatter_pdf) * (dvc*mis_power(reverse_pdf) + dvcm);
+        dvcm = mis_power(1 / scatter_pdf);
+
+        ray.Origin    = vertex.position;
+        ray.Direction = hit.scatter;
+    }
+    return vertices_count;
+}
+
+// s = 1: connect a camera vertex to a sampled point on the emitters
+float3 connect_bdpt_emitter(inout Sampler rng, RayPayload hit, float3 position, float3 view_direction, float dvcm, float dvc) {
+    float3 light_point;
+    EmitterTriangle emitter = sample_emitter(rng, light_point);
+
+    float3 offset    = light_point - position;
+    float  distance  = length(offset);
+    float3 direction = offset / distance;
+
+    float camera_cosine = dot(hit.normal, direction);
+    float light_cosine  = -dot(emitter.normal, direction);
+    if (camera_cosine <= 0 || light_cosine <= 0) return 0;
+
+    float direct_pdf   = light_sampling_pdf(distance, light_cosine);
+    float emission_pdf = light_cosine / (TAU/2) / g.emitters_total_area;
+    float brdf_pdf     = camera_cosine / (TAU/2);
+    float reverse_pdf  = dot(hit.normal, view_direction) / (TAU/2);
+
+    float w_light  = mis_power(brdf_pdf / direct_pdf);
+    float w_camera = mis_power(emission_pdf * camera_cosine / (direct_pdf * light_cosine)) * (dvcm + dvc*mis_power(reverse_pdf));
+
+    if (!is_visible(position, direction, distance)) return 0;
+
+    float3 emission = get_emitter_color(emitter) * light_cosine;
+    float3 brdf     = eval_brdf(hit.shader, hit.albedo, hit.normal, direction);
+    return emission * brdf * camera_cosine / direct_pdf / (w_light + 1 + w_camera);
+}
+
+// s > 1: connect a camera vertex to a light subpath vertex
+float3 connect_bdpt_vertices(BdptVertex light, RayPayload hit, float3 position, float3 view_direction, float dvcm, float dvc) {
+    float3 offset    = light.position - position;
+    float  distance2 = dot(offset, offset);
+    float  distance  = sqrt(distance2);
+    float3 direction = offset / distance;
+
+    float camera_cosine = dot(hit.normal, direction);
+    float light_cosine  = -dot(light.normal, direction);
+    if (camera_cosine <= 0 || light_cosine <= 0) return 0;
+
+    // pdfs of generating the connecting segment from either end, converted to area measure at the other end
+    float camera_pdf         = camera_cosine / (TAU/2) * light_cosine  / distance2;
+    float light_pdf          = light_cosine  / (TAU/2) * camera_cosine / distance2;
+    float camera_reverse_pdf = dot(hit.normal,   view_direction) / (TAU/2);
+    float light_reverse_pdf  = dot(light.normal, light.incident) / (TAU/2);
+
+    float w_light  = mis_power(camera_pdf) * (light.dvcm + light.dvc*mis_power(light_reverse_pdf));
+    float w_camera = mis_power(light_pdf)  * (dvcm       + dvc*mis_power(camera_reverse_pdf));
+
+    if (!is_visible(position, direction, distance)) return 0;
+
+    float3 camera_brdf = eval_brdf(hit.shader,   hit.albedo,   hit.normal,   direction);
+    float3 light_brdf  = eval_brdf(light.shader, light.albedo, light.normal, light.incident);
+    float  geometry    = camera_cosine * light_cosine / distance2;
+    return light.throughput * light_brdf * geometry * camera_brdf / (w_light + 1 + w_camera);
+}
+
+// `first_ray` and `first_hit` are set to the camera ray and its first hit
+float4 trace_bidirectional_sample(inout Sampler rng, out RayDesc first_ray, out FirstHit first_hit) {
+    // longer light subpaths would be truncated by the vertex storage, which would bias the mis weights
+    uint max_path_length = min(g.bounces_per_sample + 1, BDPT_MAX_LIGHT_VERTICES + 2);
+
+    Sampler light_rng = rng;
+    light_rng.seed = hash(uint2(rng.seed, 1)); // independent scramble for the light subpath
+
+    BdptVertex light_vertices[BDPT_MAX_LIGHT_VERTICES];
+    uint light_vertices_count = trace_light_subpath(light_rng, max_path_length, light_vertices);
+
+    RayDesc ray = generate_camera_ray(rng);
+    first_ray = ray;
+    first_hit.t      = INFINITY;
+    first_hit.normal = 0;
+    first_hit.albedo = 0;
+    first_hit.ids    = ~0;
+
+    float4 radiance   = 0;
+    float3 throughput = 1;
+    float  dvcm       = 0; // no strategy reaches the camera from the light side
+    float  dvc        = 0;
+
+    for (uint path_length = 1;; path_length++) {
+        rng.dimension = SAMPLER_CAMERA_DIMENSIONS + (path_length - 1)*SAMPLER_BOUNCE_DIMENSIONS;
+        uint flags = path_length == 1 && (g.aovs & AOV_IDS) ? PAYLOAD_WRITE_IDS : 0;
+        RayPayload hit = trace_bdpt_segment(rng, ray, path_length - 1, flags);
+        if (path_length == 1) radiance.a += !isinf(hit.t);
+        if (isinf(hit.t)) break;
+        if (path_length == 1) {
+            first_hit.t      = hit.t;
+            first_hit.normal = hit.normal;
+            first_hit.albedo = hit.albedo;
+            first_hit.ids    = hit.ids;
+        }
+
+        float3 position        = ray.Origin + hit.t*ray.Direction;
+        float3 view_direction  = -ray.Direction;
+        float  incident_cosine = dot(hit.normal, view_direction);
+        dvcm *= mis_power(hit.t*hit.t);
+        dvcm /= mis_power(incident_cosine);
+        dvc  /= mis_power(incident_cosine);
+
+        // s = 0: the camera subpath hits an emitter
+        if (hit.shader == Shader::Light) {
+            float w_camera = 0;
+            if (path_length > 1) {
+                float direct_pdf   = 1 / g.emitters_total_area;
+                float emission_pdf = direct_pdf * incident_cosine / (TAU/2);
+                w_camera = mis_power(direct_pdf)*dvcm + mis_power(emission_pdf)*dvc;
+            }
+            radiance.rgb += throughput * hit.emission / (1 + w_camera);
+            break;
+        }
+
+        // subsurface emission can only be gathered by camera subpaths
+        radiance.rgb += throughput * hit.emission;
+        if (path_length >= max_path_length) break;
+
+        if (g.emitters_count > 0) {
+            radiance.rgb += throughput * connect_bdpt_emitter(rng, hit, position, view_direction, dvcm, dvc);
+        }
+        for (uint i = 0; i < light_vertices_count; i++) {
+            if (light_vertices[i].path_length + 1 + path_length > max_path_length) break;
+            radiance.rgb += throughput * connect_bdpt_vertices(light_vertices[i], hit, position, view_direction, dvcm, dvc);
+        }
+
+        // scatter along the direction sampled by the hit shader
+        float scatter_cosine = dot(hit.scatter, hit.normal);
+        float scatter_pdf    = hit.pdf;
+        float reverse_pdf    = incident_cosine / (TAU/2);
+        if (scatter_pdf <= 0 || !any(hit.reflectance)) break;
+
+        throughput *= hit.reflectance;
+        dvc  = mis_power(scatter_cosine / scatter_pdf) * (dvc*mis_power(reverse_pdf) + dvcm);
+        dvcm = mis_power(1 / scatter_pdf);
+
+        ray.Origin    = position;
+        ray.Direction = hit.scatter;
+    }
+    return radiance;
+}
+
+[shader("raygeneration")]
+void bdpt_rgen() {
+    float4 accumulated_samples = 0;
+
+    RayDesc  first_ray;
+    FirstHit first_hit;
+    for (uint sample_index = 0; sample_index < g.samples_per_pixel; sample_index++) {
+        Sampler  rng = generate_pixel_sampler(traced_pixel(), sample_index);
+        RayDesc  ray;
+        FirstHit hit;
+        accumulated_samples += trace_bidirectional_sample(rng, ray, hit);
+        if (sample_index == 0) {
+            first_ray = ray;
+            first_hit = hit;
+        }
+    }
+    accumulated_samples /= g.samples_per_pixel;
+    write_accumulated_samples(accumulated_samples, first_ray, first_hit);
 }
 
 // DEBUG HELPERS
@@ -363,7 +2133,7 @@ void debug_draw_translucent_samples(inout RayPayload payload, Attributes attr) {
     // const float3 grid_origin = -0.15299781;
     // const uint3  grid_dimensions = 53;
 
-    float3 hit = WorldRayOrigin() + RayTCurrent()*WorldRayDirection();
+    float3 hit = ObjectRayOrigin() + RayTCurrent()*ObjectRayDirection();
 
     // float3 cell = floor((hit - grid_origin) / grid_cell_width) % 3;
     // payload.emission = cell / 2;
@@ -371,9 +2141,7 @@ void debug_draw_translucent_samples(inout RayPayload payload, Attributes attr) {
     float min_d = INFINITY;
     float3 color = 0;
     for (int i = samples_count-1; i >= 0; i--) {
-        SamplePoint sample_point = samples[i];
-
-        float3 d = sample_point.position - hit;
+        float3 d = (positions[i] - hit) * translucent.scale;
         // if (dot(d, d) <= rejection_radius*rejection_radius*0.25) {
         // if (dot(d, d) <= 0.000001) {
             // // payload.emission = 1;
@@ -383,7 +2151,7 @@ void debug_draw_translucent_samples(inout RayPayload payload, Attributes attr) {
         // }
         if (length(d) < min_d) {
             min_d = length(d);
-            color = sample_point.payload;
+            color = payloads[i].xyz;
         }
 
         // float3 m = WorldRayOrigin() - sample_point.position;
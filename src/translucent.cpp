@@ -0,0 +1,375 @@
+#include "translucent.h"
+
+namespace Translucent {
+
+// node of the level being built, covering a range of the point indices
+struct PendingNode {
+    UINT     first, count;
+    XMFLOAT3 lower, upper; // bounds, halved at each level
+};
+
+void build_octree(TranslucentOctree* octree, ArrayView<SamplePoint> points, float point_area) {
+    octree->nodes.len         = 0;
+    octree->point_indices.len = 0;
+    octree->levels_count      = 0;
+    if (!points.len) return;
+
+    for (UINT i = 0; i < points.len; i++) array_push(&octree->point_indices, i);
+
+    PendingNode root = { 0, (UINT) points.len };
+    {
+        XMVECTOR lower = g_XMInfinity, upper = g_XMNegInfinity;
+        for (auto& point : points) {
+            XMVECTOR p = XMLoadFloat3(&point.position);
+            lower = XMVectorMin(lower, p);
+            upper = XMVectorMax(upper, p);
+        }
+        XMStoreFloat3(&root.lower, lower);
+        XMStoreFloat3(&root.upper, upper);
+    }
+
+    Array<PendingNode> level = {}, next_level = {};
+    Array<UINT>        scratch = array_init<UINT>(points.len);
+    scratch.len = points.len;
+    array_push(&level, root);
+
+    while (level.len) {
+        UINT depth = octree->levels_count;
+        octree->level_offsets[octree->levels_count++] = octree->nodes.len;
+
+        // the children of this level follow all of its nodes
+        UINT next_level_offset = octree->nodes.len + level.len;
+        next_level.len = 0;
+
+        for (auto& pending : level) {
+            ArrayView<UINT> indices = array_from(octree->point_indices.ptr + pending.first, pending.count);
+
+            TranslucentNode node = {};
+            {
+                XMVECTOR centroid = XMVectorZero();
+                for (auto i : indices) centroid += XMLoadFloat3(&points[i].position);
+                centroid /= (float) indices.len;
+
+                float radius = 0;
+                for (auto i : indices) radius = max(radius, XMVectorGetX(XMVector3Length(XMLoadFloat3(&points[i].position) - centroid)));
+
+                XMStoreFloat3(&node.centroid, centroid);
+                node.radius = radius;
+                node.area   = point_area * indices.len;
+            }
+
+            if (pending.count <= TRANSLUCENT_OCTREE_LEAF_POINTS || depth + 1 >= TRANSLUCENT_OCTREE_MAX_DEPTH) {
+                node.leaf  = true;
+                node.first = pending.first;
+                node.count = pending.count;
+                array_push(&octree->nodes, node);
+                continue;
+            }
+
+            // bucket the points by octant of the bounds' middle
+            XMFLOAT3 middle = XMFLOAT3(
+                0.5f*(pending.lower.x + pending.upper.x),
+                0.5f*(pending.lower.y + pending.upper.y),
+                0.5f*(pending.lower.z + pending.upper.z)
+            );
+            auto octant = [&](UINT i) {
+                XMFLOAT3 p = points[i].position;
+                return (p.x >= middle.x) + 2*(p.y >= middle.y) + 4*(p.z >= middle.z);
+            };
+
+            UINT offsets[9] = {};
+            for (auto i : indices) offsets[octant(i) + 1] += 1;
+            for (UINT o = 0; o < 8; o++) offsets[o + 1] += offsets[o];
+
+            UINT cursors[8];
+            memcpy(cursors, offsets, sizeof(cursors));
+            for (auto i : indices) scratch[pending.first + cursors[octant(i)]++] = i;
+            memcpy(indices.ptr, scratch.ptr + pending.first, indices.len*sizeof(UINT));
+
+            node.leaf  = false;
+            node.first = next_level_offset + next_level.len;
+            node.count = 0;
+            for (UINT o = 0; o < 8; o++) {
+                if (offsets[o + 1] == offsets[o]) continue;
+
+                PendingNode child = { pending.first + offsets[o], offsets[o + 1] - offsets[o], pending.lower, pending.upper };
+                if (o & 1) child.lower.x = middle.x; else child.upper.x = middle.x;
+                if (o & 2) child.lower.y = middle.y; else child.upper.y = middle.y;
+                if (o & 4) child.lower.z = middle.z; else child.upper.z = middle.z;
+                array_push(&next_level, child);
+                node.count += 1;
+            }
+            array_push(&octree->nodes, node);
+        }
+
+        Prelude::swap(&level, &next_level);
+    }
+    octree->level_offsets[octree->levels_count] = octree->nodes.len;
+
+    array_free(&level);
+    array_free(&next_level);
+    array_free(&scratch);
+}
+
+void free_octree(TranslucentOctree* octree) {
+    array_free(&octree->nodes);
+    array_free(&octree->point_indices);
+    octree->levels_count = 0;
+}
+
+// spread the low 10 bits of v to every third bit
+static UINT spread_bits(UINT v) {
+    v = (v | (v << 16)) & 0x030000ff;
+    v = (v | (v <<  8)) & 0x0300f00f;
+    v = (v | (v <<  4)) & 0x030c30c3;
+    v = (v | (v <<  2)) & 0x09249249;
+    return v;
+}
+
+void morton_order(Array<UINT>* order, ArrayView<SamplePoint> points) {
+    order->len = 0;
+    if (!points.len) return;
+
+    XMVECTOR lower = g_XMInfinity, upper = g_XMNegInfinity;
+    for (auto& point : points) {
+        XMVECTOR p = XMLoadFloat3(&point.position);
+        lower = XMVectorMin(lower, p);
+        upper = XMVectorMax(upper, p);
+    }
+    // cubic cells, so that the curve is isotropic
+    XMFLOAT3 extent;
+    XMStoreFloat3(&extent, upper - lower);
+    float scale = 1023 / max(max(max(extent.x, extent.y), extent.z), FLT_MIN);
+
+    Array<UINT> keys = array_init<UINT>(points.len);
+    for (auto& point : points) {
+        XMFLOAT3 q;
+        XMStoreFloat3(&q, (XMLoadFloat3(&point.position) - lower) * scale);
+        array_push(&keys, spread_bits((UINT) q.x) | spread_bits((UINT) q.y) << 1 | spread_bits((UINT) q.z) << 2);
+    }
+
+    Array<UINT> scratch = array_init<UINT>(points.len);
+    array_push_uninitialized(&scratch, points.len);
+    for (UINT i = 0; i < points.len; i++) array_push(order, i);
+
+    // least significant digit radix sort, of 10 bits per pass
+    for (UINT shift = 0; shift < 30; shift += 10) {
+        UINT offsets[1024 + 1] = {};
+        for (auto i : *order) offsets[((keys[i] >> shift) & 1023) + 1] += 1;
+        for (UINT d = 0; d < 1024; d++) offsets[d + 1] += offsets[d];
+
+        for (auto i : *order) scratch[offsets[(keys[i] >> shift) & 1023]++] = i;
+        Prelude::swap(order, &scratch);
+    }
+
+    array_free(&keys);
+    array_free(&scratch);
+}
+
+void build_grid(TranslucentGrid* grid, ArrayView<SamplePoint> points, float cell_size) {
+    grid->cells.len         = 0;
+    grid->point_indices.len = 0;
+    grid->cell_size         = 0;
+    if (!points.len || cell_size <= 0) return;
+
+    XMVECTOR lower = g_XMInfinity, upper = g_XMNegInfinity;
+    for (auto& point : points) {
+        XMVECTOR p = XMLoadFloat3(&point.position);
+        lower = XMVectorMin(lower, p);
+        upper = XMVectorMax(upper, p);
+    }
+    XMFLOAT3 extent;
+    XMStoreFloat3(&grid->origin, lower);
+    XMStoreFloat3(&extent,       upper - lower);
+
+    auto cells_count = [&](float size) {
+        grid->dimensions = XMUINT3(
+            (UINT) (extent.x / size) + 1,
+            (UINT) (extent.y / size) + 1,
+            (UINT) (extent.z / size) + 1
+        );
+        return (UINT64) grid->dimensions.x * grid->dimensions.y * grid->dimensions.z;
+    };
+    while (cells_count(cell_size) > TRANSLUCENT_GRID_MAX_CELLS * (UINT64) points.len) cell_size *= 2;
+    grid->cell_size = cell_size;
+
+    auto cell = [&](SamplePoint* point) {
+        UINT x = min((UINT) ((point->position.x - grid->origin.x) / cell_size), grid->dimensions.x - 1);
+        UINT y = min((UINT) ((point->position.y - grid->origin.y) / cell_size), grid->dimensions.y - 1);
+        UINT z = min((UINT) ((point->position.z - grid->origin.z) / cell_size), grid->dimensions.z - 1);
+        return (z*grid->dimensions.y + y)*grid->dimensions.x + x;
+    };
+
+    // counting sort of the points by cell
+    UINT total_cells = grid->dimensions.x * grid->dimensions.y * grid->dimensions.z;
+    memset(array_push_uninitialized(&grid->cells, total_cells + 1).ptr, 0, (total_cells + 1)*sizeof(UINT));
+    for (auto& point : points) grid->cells[cell(&point) + 1] += 1;
+    for (UINT i = 0; i < total_cells; i++) grid->cells[i + 1] += grid->cells[i];
+
+    Array<UINT> cursors = array_init<UINT>(total_cells);
+    memcpy(array_push_uninitialized(&cursors, total_cells).ptr, grid->cells.ptr, total_cells*sizeof(UINT));
+    array_push_uninitialized(&grid->point_indices, points.len);
+    for (UINT i = 0; i < points.len; i++) grid->point_indices[cursors[cell(&points[i])]++] = i;
+    array_free(&cursors);
+}
+
+void free_grid(TranslucentGrid* grid) {
+    array_free(&grid->cells);
+    array_free(&grid->point_indices);
+    grid->cell_size = 0;
+}
+
+XMUINT2 encode_position(TranslucentGrid* grid, XMFLOAT3 position) {
+    const UINT max_value = (1u << TRANSLUCENT_POSITION_BITS) - 1;
+    float      scale     = max_value / grid->cell_size;
+
+    UINT q[3];
+    float p[3] = { position.x - grid->origin.x, position.y - grid->origin.y, position.z - grid->origin.z };
+    UINT  d[3] = { grid->dimensions.x, grid->dimensions.y, grid->dimensions.z };
+    for (UINT a = 0; a < 3; a++) q[a] = (UINT) min(max(p[a] * scale / d[a] + 0.5f, 0.0f), (float) max_value);
+
+    return XMUINT2(q[0] | q[1] << 21, q[1] >> 11 | q[2] << 10);
+}
+
+XMFLOAT3 decode_position(TranslucentGrid* grid, XMUINT2 encoded) {
+    const UINT max_value = (1u << TRANSLUCENT_POSITION_BITS) - 1;
+    float      scale     = grid->cell_size / max_value;
+
+    UINT x = encoded.x & max_value;
+    UINT y = (encoded.x >> 21 | encoded.y << 11) & max_value;
+    UINT z = encoded.y >> 10;
+    return XMFLOAT3(
+        grid->origin.x + x * scale * grid->dimensions.x,
+        grid->origin.y + y * scale * grid->dimensions.y,
+        grid->origin.z + z * scale * grid->dimensions.z
+    );
+}
+
+float position_error_bound(TranslucentGrid* grid) {
+    const UINT max_value = (1u << TRANSLUCENT_POSITION_BITS) - 1;
+
+    float o[3] = { grid->origin.x, grid->origin.y, grid->origin.z };
+    UINT  d[3] = { grid->dimensions.x, grid->dimensions.y, grid->dimensions.z };
+
+    float steps2    = 0;
+    float magnitude = 0;
+    for (UINT a = 0; a < 3; a++) {
+        float extent = grid->cell_size * d[a];
+        float step   = extent / max_value;
+        steps2   += step*step;
+        magnitude = max(magnitude, fabsf(o[a]) + extent);
+    }
+    return 0.5f*sqrtf(steps2) + 8*FLT_EPSILON*magnitude;
+}
+
+UINT encode_rgb9e5(XMFLOAT3 rgb) {
+    float c[3] = { rgb.x, rgb.y, rgb.z };
+    for (UINT i = 0; i < 3; i++) c[i] = min(max(c[i], 0.0f), (float) RGB9E5_MAX);
+    float max_channel = max(c[0], max(c[1], c[2]));
+
+    int   exponent = (int) max(-16.0f, floorf(log2f(max_channel))) + 16; // biased by 15, of the mantissa's top bit
+    float scale    = exp2f((float) (exponent - 15 - 9));
+    if (floorf(max_channel / scale + 0.5f) == 512) { // rounded up into the next exponent
+        exponent += 1;
+        scale    *= 2;
+    }
+    UINT m[3];
+    for (UINT i = 0; i < 3; i++) m[i] = (UINT) floorf(c[i] / scale + 0.5f);
+    return m[0] | m[1] << 9 | m[2] << 18 | (UINT) exponent << 27;
+}
+
+XMFLOAT3 decode_rgb9e5(UINT encoded) {
+    float scale = exp2f((float) ((int) (encoded >> 27) - 15 - 9));
+    return XMFLOAT3((encoded & 511) * scale, ((encoded >> 9) & 511) * scale, ((encoded >> 18) & 511) * scale);
+}
+
+float rgb9e5_error() {
+    // the largest channel steps through every mantissa of every exponent, the others at fixed fractions of it
+    float error = 0;
+    for (int e = -16; e < 16; e++) {
+        for (UINT i = 0; i < 512; i++) {
+            float    largest = ldexpf(1 + i/512.0f, e);
+            XMFLOAT3 rgb     = XMFLOAT3(largest, 0.7071f*largest, 0.0123f*largest);
+            if (rgb.x > RGB9E5_MAX) continue;
+
+            XMFLOAT3 decoded = decode_rgb9e5(encode_rgb9e5(rgb));
+            error = max(error, max(fabsf(decoded.x - rgb.x), max(fabsf(decoded.y - rgb.y), fabsf(decoded.z - rgb.z))) / largest);
+        }
+    }
+    return error;
+}
+
+// one channel of eval_bssrdf_dipole
+static float eval_dipole(float scattering, float absorption, float eta, float radius) {
+    float attenuation           = scattering + absorption;
+    float mean_free_path        = 1 / attenuation;
+    float albedo                = scattering / attenuation;
+    float effective_attenuation = sqrtf(3 * scattering * absorption);
+
+    float diffuse_fresnel = -1.440f/(eta*eta) + 0.710f/eta + 0.668f + 0.0636f*eta;
+
+    float z_real    = mean_free_path;
+    float d_real    = radius + z_real;
+    float c_real    = z_real * (effective_attenuation + 1/d_real);
+
+    float z_virtual = mean_free_path * (1 + 1.25f*(1 + diffuse_fresnel)/(1 - diffuse_fresnel));
+    float d_virtual = radius + z_virtual;
+    float c_virtual = z_virtual * (effective_attenuation + 1/d_virtual);
+
+    float m_real    = c_real    * expf(-effective_attenuation * d_real)    / (d_real*d_real);
+    float m_virtual = c_virtual * expf(-effective_attenuation * d_virtual) / (d_virtual*d_virtual);
+    return max(0.0f, albedo/(2*TAUf) * (m_real + m_virtual));
+}
+
+float dipole_radius(XMFLOAT3 scattering, XMFLOAT3 absorption, float refractive_index, float tolerance) {
+    float s[3] = { scattering.x, scattering.y, scattering.z };
+    float a[3] = { absorption.x, absorption.y, absorption.z };
+
+    float radius = 0;
+    for (UINT c = 0; c < 3; c++) {
+        float peak = eval_dipole(s[c], a[c], refractive_index, 0);
+        if (!(peak > 0) || !isfinite(peak)) continue;
+
+        // the profile decreases monotonically: grow the bracket from the mean free path until it falls below the tolerance
+        float lower = 0;
+        float upper = 1 / (s[c] + a[c]);
+        for (UINT i = 0; i < 64 && eval_dipole(s[c], a[c], refractive_index, upper) > tolerance*peak; i++) {
+            lower  = upper;
+            upper *= 2;
+        }
+        for (UINT i = 0; i < 32; i++) {
+            float middle = 0.5f * (lower + upper);
+            if (eval_dipole(s[c], a[c], refractive_index, middle) > tolerance*peak) lower = middle;
+            else                                                                   upper = middle;
+        }
+        radius = max(radius, upper);
+    }
+    return radius;
+}
+
+float tabulate_dipole(ArrayView<XMFLOAT3> table, XMFLOAT3 scattering, XMFLOAT3 absorption, float refractive_index, float radius_max) {
+    float s[3] = { scattering.x, scattering.y, scattering.z };
+    float a[3] = { absorption.x, absorption.y, absorption.z };
+
+    auto radius = [&](float u) { return u*u * radius_max; };
+
+    float max_error = 0;
+    for (UINT c = 0; c < 3; c++) {
+        float* entries = &table[0].x + c;
+        for (UINT i = 0; i < table.len; i++) entries[3*i] = eval_dipole(s[c], a[c], refractive_index, radius(i / (float) (table.len - 1)));
+
+        // sampled inside each interval, where the convex profile departs from the chords
+        float peak = entries[0];
+        for (UINT i = 0; i + 1 < table.len && peak > 0; i++) {
+            for (UINT j = 1; j < 4; j++) {
+                float t     = j / 4.0f;
+                float exact = eval_dipole(s[c], a[c], refractive_index, radius((i + t) / (table.len - 1)));
+                float error = fabsf(exact - (entries[3*i] + t*(entries[3*(i + 1)] - entries[3*i])));
+                max_error = max(max_error, error / peak);
+            }
+        }
+    }
+    return max_error;
+}
+
+} // namespace Translucent
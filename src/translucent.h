@@ -0,0 +1,63 @@
+#pragma once
+#include "prelude.h"
+
+// host-side acceleration structures over the sample points of translucent instances, which hold the incident flux
+// gathered by the subsurface scattering in raytracing.hlsl
+
+// point octree for hierarchical integration, after Jensen and Buhler 2002,
+// "A Rapid Hierarchical Rendering Technique for Translucent Materials"
+struct TranslucentOctree {
+    Array<TranslucentNode> nodes;
+    Array<UINT>            point_indices; // of the leaves' points, each leaf's range contiguous
+    UINT                   levels_count;
+    UINT                   level_offsets[TRANSLUCENT_OCTREE_MAX_DEPTH + 1];
+};
+
+// uniform grid for gathering the points within the bssrdf's cutoff radius, with the points of each cell contiguous
+struct TranslucentGrid {
+    Array<UINT> cells;         // offsets into point_indices, cells count + 1
+    Array<UINT> point_indices;
+    XMFLOAT3    origin;
+    float       cell_size;
+    XMUINT3     dimensions;
+};
+
+namespace Translucent {
+
+// nodes are subdivided at the middle of their bounds until they hold TRANSLUCENT_OCTREE_LEAF_POINTS or fewer
+void build_octree(TranslucentOctree* octree, ArrayView<SamplePoint> points, float point_area);
+
+void free_octree(TranslucentOctree* octree);
+
+// permutation sorting the points along a 3D Morton curve over their bounds, of 10 bits per axis
+void morton_order(Array<UINT>* order, ArrayView<SamplePoint> points);
+
+// cells of cell_size over the points' bounds, grown to at most TRANSLUCENT_GRID_MAX_CELLS per point
+void build_grid(TranslucentGrid* grid, ArrayView<SamplePoint> points, float cell_size);
+
+void free_grid(TranslucentGrid* grid);
+
+// position quantized to TRANSLUCENT_POSITION_BITS per axis over the cells of the grid, as decoded in raytracing.hlsl
+XMUINT2  encode_position(TranslucentGrid* grid, XMFLOAT3 position);
+XMFLOAT3 decode_position(TranslucentGrid* grid, XMUINT2 encoded);
+
+// largest distance of a position within the grid from its decoded encoding: half the diagonal of a quantization step,
+// and a few float roundings of the decoded coordinates
+float position_error_bound(TranslucentGrid* grid);
+
+// compact payloads of nonnegative colors, as encoded in raytracing.hlsl
+UINT     encode_rgb9e5(XMFLOAT3 rgb);
+XMFLOAT3 decode_rgb9e5(UINT encoded);
+
+// largest error of an RGB9E5 round trip relative to the color's largest channel, over colors spanning every exponent
+float rgb9e5_error();
+
+// radius beyond which every channel of the dipole profile is below `tolerance` of its value at radius 0, found by bisection
+// on the profile itself, including the falloff of its 1/d^2 factors; 0 if the profile vanishes
+float dipole_radius(XMFLOAT3 scattering, XMFLOAT3 absorption, float refractive_index, float tolerance);
+
+// the dipole profile of eval_bssrdf_dipole in raytracing.hlsl at radius = (i/(table.len - 1))^2 * radius_max,
+// returning the largest error of interpolating linearly between the entries, relative to the profile's peak
+float tabulate_dipole(ArrayView<XMFLOAT3> table, XMFLOAT3 scattering, XMFLOAT3 absorption, float refractive_index, float radius_max);
+
+} // namespace Translucent